@@ -0,0 +1,339 @@
+#pragma once
+
+// Shared infrastructure of the standalone multi-threaded benchmarks
+
+#include "multiqueue/backoff.hpp"
+#include "multiqueue/modes/random.hpp"
+#include "multiqueue/modes/stick_mark.hpp"
+#include "multiqueue/modes/stick_random.hpp"
+#include "multiqueue/modes/stick_swap.hpp"
+#include "multiqueue/multiqueue.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <numeric>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace bench {
+
+// Pins the calling thread to core `id` modulo the number of available cores
+inline bool pin_to_core(unsigned id) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(id % std::max(1U, std::thread::hardware_concurrency()), &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// A reusable spinning barrier, used to start all threads at once
+class Barrier {
+    std::atomic_uint remaining_;
+    std::atomic_uint phase_{0};
+    unsigned num_threads_;
+
+   public:
+    explicit Barrier(unsigned num_threads) : remaining_{num_threads}, num_threads_{num_threads} {
+    }
+
+    void wait() noexcept {
+        auto const phase = phase_.load(std::memory_order_relaxed);
+        if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            remaining_.store(num_threads_, std::memory_order_relaxed);
+            phase_.store(phase + 1, std::memory_order_release);
+            return;
+        }
+        while (phase_.load(std::memory_order_acquire) == phase) {
+            std::this_thread::yield();
+        }
+    }
+};
+
+inline std::vector<std::string> split(std::string_view s, char delimiter) {
+    std::vector<std::string> parts;
+    while (true) {
+        auto pos = s.find(delimiter);
+        parts.emplace_back(s.substr(0, pos));
+        if (pos == std::string_view::npos) {
+            return parts;
+        }
+        s.remove_prefix(pos + 1);
+    }
+}
+
+struct Percentiles {
+    double mean{};
+    std::uint64_t p50{};
+    std::uint64_t p90{};
+    std::uint64_t p99{};
+    std::uint64_t p999{};
+    std::uint64_t max{};
+};
+
+// Sorts the samples in place
+inline Percentiles percentiles(std::vector<std::uint64_t> &samples) {
+    if (samples.empty()) {
+        return {};
+    }
+    std::sort(samples.begin(), samples.end());
+    auto at = [&samples](double q) {
+        auto i = static_cast<std::size_t>(q * static_cast<double>(samples.size() - 1));
+        return samples[i];
+    };
+    auto const sum = std::accumulate(samples.begin(), samples.end(), 0.0,
+                                     [](double acc, std::uint64_t v) { return acc + static_cast<double>(v); });
+    return {sum / static_cast<double>(samples.size()), at(0.5), at(0.9), at(0.99), at(0.999), samples.back()};
+}
+
+// Minimal streaming JSON writer, sufficient for flat benchmark reports
+class JsonWriter {
+    std::ostream &out_;
+    std::vector<bool> first_;
+
+    void separator() {
+        if (first_.empty()) {
+            return;
+        }
+        if (!first_.back()) {
+            out_ << ',';
+        }
+        first_.back() = false;
+    }
+
+    void write_key(std::string_view key) {
+        if (!key.empty()) {
+            write(key);
+            out_ << ':';
+        }
+    }
+
+    void write(std::string_view s) {
+        out_ << '"';
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                out_ << '\\';
+            }
+            out_ << c;
+        }
+        out_ << '"';
+    }
+
+    void write(char const *s) {
+        write(std::string_view{s});
+    }
+
+    void write(std::string const &s) {
+        write(std::string_view{s});
+    }
+
+    void write(bool b) {
+        out_ << (b ? "true" : "false");
+    }
+
+    template <typename T, typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+    void write(T v) {
+        if constexpr (std::is_floating_point_v<T>) {
+            out_ << std::setprecision(6) << v;
+        } else {
+            out_ << v;
+        }
+    }
+
+   public:
+    explicit JsonWriter(std::ostream &out) : out_{out} {
+    }
+
+    JsonWriter &begin_object(std::string_view key = {}) {
+        separator();
+        write_key(key);
+        out_ << '{';
+        first_.push_back(true);
+        return *this;
+    }
+
+    JsonWriter &end_object() {
+        out_ << '}';
+        first_.pop_back();
+        if (first_.empty()) {
+            out_ << '\n';
+        }
+        return *this;
+    }
+
+    JsonWriter &begin_array(std::string_view key = {}) {
+        separator();
+        write_key(key);
+        out_ << '[';
+        first_.push_back(true);
+        return *this;
+    }
+
+    JsonWriter &end_array() {
+        out_ << ']';
+        first_.pop_back();
+        return *this;
+    }
+
+    template <typename T>
+    JsonWriter &value(std::string_view key, T const &v) {
+        separator();
+        write_key(key);
+        write(v);
+        return *this;
+    }
+
+    template <typename T>
+    JsonWriter &value(T const &v) {
+        return value(std::string_view{}, v);
+    }
+
+    JsonWriter &percentiles(std::string_view key, Percentiles const &p) {
+        begin_object(key);
+        value("mean", p.mean).value("p50", p.p50).value("p90", p.p90).value("p99", p.p99).value("p99.9", p.p999).value("max", p.max);
+        return end_object();
+    }
+};
+
+template <typename Mode, int PopTries, bool Scan, typename Backoff = multiqueue::backoff::None,
+          bool SeparateTopKey = false, bool ShadowTopKeys = false, std::size_t PushMailboxSize = 0,
+          std::size_t EliminationSlots = 0>
+struct Policy : multiqueue::DefaultPolicy {
+    using mode_type = Mode;
+    static constexpr int pop_tries = PopTries;
+    static constexpr bool scan = Scan;
+    using backoff_type = Backoff;
+    static constexpr bool separate_top_key = SeparateTopKey;
+    static constexpr bool shadow_top_keys = ShadowTopKeys;
+    static constexpr std::size_t push_mailbox_size = PushMailboxSize;
+    // Elimination is enabled together with its slots, keeping elements alone is not compiled in
+    static constexpr bool eliminate_pushes = EliminationSlots > 0;
+    static constexpr std::size_t elimination_slots = EliminationSlots;
+};
+
+template <typename Config, typename = void>
+struct has_stickiness : std::false_type {};
+
+template <typename Config>
+struct has_stickiness<Config, std::void_t<decltype(std::declval<Config &>().stickiness)>> : std::true_type {};
+
+// Only the sticky modes have a stickiness parameter
+template <typename Config>
+void set_stickiness(Config &config, int stickiness) {
+    if constexpr (has_stickiness<Config>::value) {
+        config.stickiness = stickiness;
+    }
+}
+
+template <typename T>
+struct type_tag {
+    using type = T;
+};
+
+inline constexpr std::string_view mode_names = "random, random_strict, random_8, stick_random, stick_swap, stick_mark";
+inline constexpr std::string_view backoff_names = "none, pause, exponential, yield, park";
+inline constexpr std::string_view layout_names = "packed, separate, shadow, mailbox, eliminate";
+
+namespace detail {
+
+template <int PopTries, bool Scan, typename Backoff = multiqueue::backoff::None, bool SeparateTopKey = false,
+          bool ShadowTopKeys = false, std::size_t PushMailboxSize = 0, std::size_t EliminationSlots = 0, typename F>
+bool dispatch_mode(std::string_view mode, F &&f) {
+    namespace mode_ns = multiqueue::mode;
+    auto dispatch = [&f](auto tag) {
+        using mode_type = typename decltype(tag)::type;
+        f(type_tag<Policy<mode_type, PopTries, Scan, Backoff, SeparateTopKey, ShadowTopKeys, PushMailboxSize,
+                          EliminationSlots>>{});
+    };
+    if (mode == "random") {
+        dispatch(type_tag<mode_ns::Random<2>>{});
+    } else if (mode == "random_strict") {
+        dispatch(type_tag<mode_ns::Random<2, false>>{});
+    } else if (mode == "random_8") {
+        dispatch(type_tag<mode_ns::Random<8>>{});
+    } else if (mode == "stick_random") {
+        dispatch(type_tag<mode_ns::StickRandom<2>>{});
+    } else if (mode == "stick_swap") {
+        dispatch(type_tag<mode_ns::StickSwap<2>>{});
+    } else if (mode == "stick_mark") {
+        dispatch(type_tag<mode_ns::StickMark<2>>{});
+    } else {
+        return false;
+    }
+    return true;
+}
+
+}  // namespace detail
+
+// Calls `f` with a `type_tag` of the policy selected at runtime. Returns false if no such policy is compiled in.
+template <typename F>
+bool dispatch_policy(std::string_view mode, int pop_tries, bool scan, F &&f) {
+    if (pop_tries == 1) {
+        return scan ? detail::dispatch_mode<1, true>(mode, f) : detail::dispatch_mode<1, false>(mode, f);
+    }
+    if (pop_tries == 2) {
+        return scan ? detail::dispatch_mode<2, true>(mode, f) : detail::dispatch_mode<2, false>(mode, f);
+    }
+    return false;
+}
+
+// Backoff policies other than none are only compiled in for one pop try with scan
+template <typename F>
+bool dispatch_policy(std::string_view mode, int pop_tries, bool scan, std::string_view backoff, F &&f) {
+    namespace backoff_ns = multiqueue::backoff;
+    if (backoff == "none") {
+        return dispatch_policy(mode, pop_tries, scan, f);
+    }
+    if (pop_tries != 1 || !scan) {
+        return false;
+    }
+    if (backoff == "pause") {
+        return detail::dispatch_mode<1, true, backoff_ns::Pause<>>(mode, f);
+    }
+    if (backoff == "exponential") {
+        return detail::dispatch_mode<1, true, backoff_ns::Exponential<>>(mode, f);
+    }
+    if (backoff == "yield") {
+        return detail::dispatch_mode<1, true, backoff_ns::Yield>(mode, f);
+    }
+    if (backoff == "park") {
+        return detail::dispatch_mode<1, true, backoff_ns::Park<>>(mode, f);
+    }
+    return false;
+}
+
+// The separate, shadow, mailbox and eliminate layouts are only compiled in for one pop try with scan and without backoff
+template <typename F>
+bool dispatch_policy(std::string_view mode, int pop_tries, bool scan, std::string_view backoff, std::string_view layout,
+                     F &&f) {
+    if (layout == "packed") {
+        return dispatch_policy(mode, pop_tries, scan, backoff, f);
+    }
+    if (pop_tries != 1 || !scan || backoff != "none") {
+        return false;
+    }
+    if (layout == "separate") {
+        return detail::dispatch_mode<1, true, multiqueue::backoff::None, true>(mode, f);
+    }
+    if (layout == "shadow") {
+        return detail::dispatch_mode<1, true, multiqueue::backoff::None, false, true>(mode, f);
+    }
+    if (layout == "mailbox") {
+        return detail::dispatch_mode<1, true, multiqueue::backoff::None, false, false, 4>(mode, f);
+    }
+    if (layout == "eliminate") {
+        return detail::dispatch_mode<1, true, multiqueue::backoff::None, false, false, 0, 4>(mode, f);
+    }
+    return false;
+}
+
+}  // namespace bench
@@ -0,0 +1,221 @@
+#pragma once
+
+// Weighted directed graphs in CSR format, read from DIMACS or edge list files or generated synthetically
+
+#include "pcg_random.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace bench::graph {
+
+using node_type = std::uint32_t;
+using weight_type = std::uint32_t;
+
+struct Edge {
+    node_type source;
+    node_type target;
+    weight_type weight;
+};
+
+class Graph {
+    std::vector<std::size_t> offsets_;
+    std::vector<node_type> targets_;
+    std::vector<weight_type> weights_;
+
+   public:
+    struct Neighbor {
+        node_type target;
+        weight_type weight;
+    };
+
+    Graph() = default;
+
+    Graph(std::size_t num_nodes, std::vector<Edge> edges) : offsets_(num_nodes + 1, 0) {
+        std::sort(edges.begin(), edges.end(), [](Edge const &lhs, Edge const &rhs) {
+            return std::tie(lhs.source, lhs.target) < std::tie(rhs.source, rhs.target);
+        });
+        targets_.reserve(edges.size());
+        weights_.reserve(edges.size());
+        for (auto const &e : edges) {
+            if (e.source >= num_nodes || e.target >= num_nodes) {
+                throw std::out_of_range("Edge endpoint exceeds the number of nodes");
+            }
+            ++offsets_[e.source + 1];
+            targets_.push_back(e.target);
+            weights_.push_back(e.weight);
+        }
+        for (std::size_t i = 1; i < offsets_.size(); ++i) {
+            offsets_[i] += offsets_[i - 1];
+        }
+    }
+
+    [[nodiscard]] std::size_t num_nodes() const noexcept {
+        return offsets_.empty() ? 0 : offsets_.size() - 1;
+    }
+
+    [[nodiscard]] std::size_t num_edges() const noexcept {
+        return targets_.size();
+    }
+
+    template <typename F>
+    void for_each_neighbor(node_type node, F &&f) const {
+        for (auto i = offsets_[node]; i != offsets_[node + 1]; ++i) {
+            f(Neighbor{targets_[i], weights_[i]});
+        }
+    }
+};
+
+// DIMACS shortest path format: "p sp <n> <m>" header and "a <u> <v> <w>" arcs with 1-based nodes
+inline Graph read_dimacs(std::string const &path) {
+    std::ifstream in{path};
+    if (!in) {
+        throw std::runtime_error("Could not open " + path);
+    }
+    std::size_t num_nodes = 0;
+    std::vector<Edge> edges;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ls{line};
+        char type{};
+        ls >> type;
+        if (type == 'p') {
+            std::string format;
+            std::size_t num_edges{};
+            ls >> format >> num_nodes >> num_edges;
+            edges.reserve(num_edges);
+        } else if (type == 'a') {
+            node_type u{};
+            node_type v{};
+            weight_type w{};
+            ls >> u >> v >> w;
+            if (u == 0 || v == 0) {
+                throw std::runtime_error("DIMACS nodes are 1-based");
+            }
+            edges.push_back({u - 1, v - 1, w});
+        }
+    }
+    return Graph{num_nodes, std::move(edges)};
+}
+
+// One "<u> <v> [<w>]" edge per line with 0-based nodes, lines starting with '#' or '%' are comments
+inline Graph read_edge_list(std::string const &path) {
+    std::ifstream in{path};
+    if (!in) {
+        throw std::runtime_error("Could not open " + path);
+    }
+    std::size_t num_nodes = 0;
+    std::vector<Edge> edges;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#' || line[0] == '%') {
+            continue;
+        }
+        std::istringstream ls{line};
+        node_type u{};
+        node_type v{};
+        weight_type w{1};
+        if (!(ls >> u >> v)) {
+            continue;
+        }
+        ls >> w;
+        num_nodes = std::max<std::size_t>(num_nodes, std::max(u, v) + std::size_t{1});
+        edges.push_back({u, v, w});
+    }
+    return Graph{num_nodes, std::move(edges)};
+}
+
+// Four-neighborhood grid with edges in both directions
+inline Graph generate_grid(std::size_t width, std::size_t height, weight_type max_weight, std::uint64_t seed) {
+    pcg32 rng{seed};
+    std::uniform_int_distribution<weight_type> weight_dist{1, max_weight};
+    std::vector<Edge> edges;
+    edges.reserve(4 * width * height);
+    auto id = [width](std::size_t x, std::size_t y) { return static_cast<node_type>(y * width + x); };
+    for (std::size_t y = 0; y < height; ++y) {
+        for (std::size_t x = 0; x < width; ++x) {
+            if (x + 1 < width) {
+                auto w = weight_dist(rng);
+                edges.push_back({id(x, y), id(x + 1, y), w});
+                edges.push_back({id(x + 1, y), id(x, y), w});
+            }
+            if (y + 1 < height) {
+                auto w = weight_dist(rng);
+                edges.push_back({id(x, y), id(x, y + 1), w});
+                edges.push_back({id(x, y + 1), id(x, y), w});
+            }
+        }
+    }
+    return Graph{width * height, std::move(edges)};
+}
+
+// Recursive matrix graph with 2^scale nodes and the usual (0.57, 0.19, 0.19, 0.05) partition
+inline Graph generate_rmat(unsigned scale, std::size_t edge_factor, weight_type max_weight, std::uint64_t seed) {
+    pcg32 rng{seed};
+    std::uniform_real_distribution<double> prob{0.0, 1.0};
+    std::uniform_int_distribution<weight_type> weight_dist{1, max_weight};
+    std::size_t const num_nodes = std::size_t{1} << scale;
+    std::vector<Edge> edges;
+    edges.reserve(num_nodes * edge_factor);
+    for (std::size_t i = 0; i < num_nodes * edge_factor; ++i) {
+        node_type u = 0;
+        node_type v = 0;
+        for (unsigned bit = 0; bit < scale; ++bit) {
+            auto p = prob(rng);
+            u = (u << 1) | static_cast<node_type>(p >= 0.57 + 0.19 ? 1 : 0);
+            v = (v << 1) | static_cast<node_type>((p >= 0.57 && p < 0.57 + 0.19) || p >= 0.57 + 0.19 + 0.19 ? 1 : 0);
+        }
+        edges.push_back({u, v, weight_dist(rng)});
+    }
+    return Graph{num_nodes, std::move(edges)};
+}
+
+// Random points in the unit square connected if closer than the radius yielding the given expected degree. Weights
+// are the scaled euclidean distances.
+inline Graph generate_geometric(std::size_t num_nodes, double degree, weight_type max_weight, std::uint64_t seed) {
+    pcg32 rng{seed};
+    std::uniform_real_distribution<double> coord{0.0, 1.0};
+    std::vector<std::pair<double, double>> points(num_nodes);
+    for (auto &p : points) {
+        p = {coord(rng), coord(rng)};
+    }
+    double const pi = std::acos(-1.0);
+    double const radius = std::sqrt(degree / (pi * static_cast<double>(num_nodes)));
+    auto const cells = std::max<std::size_t>(1, static_cast<std::size_t>(1.0 / radius));
+    auto cell_of = [cells](double c) { return std::min(cells - 1, static_cast<std::size_t>(c * static_cast<double>(cells))); };
+    std::vector<std::vector<node_type>> grid(cells * cells);
+    for (std::size_t i = 0; i < num_nodes; ++i) {
+        grid[cell_of(points[i].second) * cells + cell_of(points[i].first)].push_back(static_cast<node_type>(i));
+    }
+    std::vector<Edge> edges;
+    for (std::size_t u = 0; u < num_nodes; ++u) {
+        auto const cx = cell_of(points[u].first);
+        auto const cy = cell_of(points[u].second);
+        for (auto y = cy == 0 ? 0 : cy - 1; y <= std::min(cells - 1, cy + 1); ++y) {
+            for (auto x = cx == 0 ? 0 : cx - 1; x <= std::min(cells - 1, cx + 1); ++x) {
+                for (auto v : grid[y * cells + x]) {
+                    if (v == u) {
+                        continue;
+                    }
+                    auto const d = std::hypot(points[u].first - points[v].first, points[u].second - points[v].second);
+                    if (d <= radius) {
+                        auto w = std::max<weight_type>(1, static_cast<weight_type>(d / radius * max_weight));
+                        edges.push_back({static_cast<node_type>(u), v, w});
+                    }
+                }
+            }
+        }
+    }
+    return Graph{num_nodes, std::move(edges)};
+}
+
+}  // namespace bench::graph
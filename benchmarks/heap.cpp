@@ -1,3 +1,5 @@
+#include "perf_counters.hpp"
+
 #include "multiqueue/heap.hpp"
 #include "multiqueue/buffered_pq.hpp"
 
@@ -7,68 +9,132 @@
 
 #include <catch2/benchmark/catch_benchmark.hpp>
 #include <catch2/catch_template_test_macros.hpp>
+#include <catch2/interfaces/catch_interfaces_capture.hpp>
 
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
 #include <iterator>
 #include <queue>
 #include <vector>
 
 static constexpr int reps = 500'000;
+// Every workload performs this many pushes and pops in total
+static constexpr std::uint64_t ops_per_workload = 2 * reps;
+
+template <typename PQ>
+static bool up(PQ& pq) {
+    for (int i = 1; i <= reps; ++i) {
+        pq.push(i);
+    }
+    for (int i = 1; i <= reps; ++i) {
+        pq.pop();
+    }
+    // to guarantee computation
+    return pq.empty();
+}
 
-TEST_CASE("std::priority_queue", "[benchmark][std]") {
-    auto pq = std::priority_queue<int, std::vector<int>, std::greater<>>{};
+template <typename PQ>
+static bool down(PQ& pq) {
+    for (int i = reps; i > 0; --i) {
+        pq.push(i);
+    }
+    for (int i = 1; i <= reps; ++i) {
+        pq.pop();
+    }
+    // to guarantee computation
+    return pq.empty();
+}
+
+template <typename PQ>
+static bool up_down(PQ& pq) {
+    for (int i = 1; i <= reps / 2; ++i) {
+        pq.push(i);
+    }
+    for (int i = reps; i > reps / 2; --i) {
+        pq.push(i);
+    }
+    for (int i = 1; i <= reps; ++i) {
+        pq.pop();
+    }
+    // to guarantee computation
+    return pq.empty();
+}
 
+template <typename PQ>
+static bool mixed(PQ& pq) {
+    for (int i = 1; i <= reps / 4; ++i) {
+        pq.push(i * 3);
+        pq.push(i);
+        pq.push(i * 4);
+        pq.push(i * 2);
+        pq.pop();
+        pq.pop();
+        pq.pop();
+    }
+    for (int i = 1; i <= reps / 4; ++i) {
+        pq.pop();
+    }
+    // to guarantee computation
+    return pq.empty();
+}
+
+// Set MULTIQUEUE_PERF_COUNTERS to additionally run every workload once with hardware counters and report them per
+// operation. Without counter support, only the timings are reported.
+static bench::PerfCounters* perf_counters() {
+    static bench::PerfCounters* const counters = []() -> bench::PerfCounters* {
+        if (std::getenv("MULTIQUEUE_PERF_COUNTERS") == nullptr) {
+            return nullptr;
+        }
+        static bench::PerfCounters instance;
+        if (!instance.available()) {
+            std::cerr << "Performance counters unavailable, reporting time only\n";
+            return nullptr;
+        }
+        return &instance;
+    }();
+    return counters;
+}
+
+template <typename PQ>
+static void count_events(char const* name, PQ& pq, bool (*workload)(PQ&)) {
+    auto* counters = perf_counters();
+    if (counters == nullptr) {
+        return;
+    }
+    auto reading = bench::measure(*counters, [&] { workload(pq); });
+    std::cout << Catch::getResultCapture().getCurrentTestName() << '/' << name << ": ";
+    bench::print_per_op(std::cout, reading, ops_per_workload);
+    std::cout << '\n';
+}
+
+template <typename PQ>
+static void benchmark_workloads(PQ& pq) {
     BENCHMARK("up") {
-        for (int i = 1; i <= reps; ++i) {
-            pq.push(i);
-        }
-        for (int i = 1; i <= reps; ++i) {
-            pq.pop();
-        }
-        // to guarantee computation
-        return pq.empty();
+        return up(pq);
     };
+    count_events("up", pq, up<PQ>);
 
     BENCHMARK("down") {
-        for (int i = reps; i > 0; --i) {
-            pq.push(i);
-        }
-        for (int i = 1; i <= reps; ++i) {
-            pq.pop();
-        }
-        // to guarantee computation
-        return pq.empty();
+        return down(pq);
     };
+    count_events("down", pq, down<PQ>);
 
     BENCHMARK("up_down") {
-        for (int i = 1; i <= reps / 2; ++i) {
-            pq.push(i);
-        }
-        for (int i = reps; i > reps / 2; --i) {
-            pq.push(i);
-        }
-        for (int i = 1; i <= reps; ++i) {
-            pq.pop();
-        }
-        // to guarantee computation
-        return pq.empty();
+        return up_down(pq);
     };
+    count_events("up_down", pq, up_down<PQ>);
 
     BENCHMARK("mixed") {
-        for (int i = 1; i <= reps / 4; ++i) {
-            pq.push(i * 3);
-            pq.push(i);
-            pq.push(i * 4);
-            pq.push(i * 2);
-            pq.pop();
-            pq.pop();
-            pq.pop();
-        }
-        for (int i = 1; i <= reps / 4; ++i) {
-            pq.pop();
-        }
-        // to guarantee computation
-        return pq.empty();
+        return mixed(pq);
     };
+    count_events("mixed", pq, mixed<PQ>);
+}
+
+TEST_CASE("std::priority_queue", "[benchmark][std]") {
+    auto pq = std::priority_queue<int, std::vector<int>, std::greater<>>{};
+
+    benchmark_workloads(pq);
 }
 
 #ifdef HAVE_BOOST
@@ -78,58 +144,7 @@ TEMPLATE_TEST_CASE_SIG("boost::d_ary_heap", "[benchmark][boost][degree]", ((unsi
 
     auto heap = heap_t{};
 
-    BENCHMARK("up") {
-        for (int i = 1; i <= reps; ++i) {
-            heap.push(i);
-        }
-        for (int i = 1; i <= reps; ++i) {
-            heap.pop();
-        }
-        // to guarantee computation
-        return heap.empty();
-    };
-
-    BENCHMARK("down") {
-        for (int i = reps; i > 0; --i) {
-            heap.push(i);
-        }
-        for (int i = 1; i <= reps; ++i) {
-            heap.pop();
-        }
-        // to guarantee computation
-        return heap.empty();
-    };
-
-    BENCHMARK("up_down") {
-        for (int i = 1; i <= reps / 2; ++i) {
-            heap.push(i);
-        }
-        for (int i = reps; i > reps / 2; --i) {
-            heap.push(i);
-        }
-        for (int i = 1; i <= reps; ++i) {
-            heap.pop();
-        }
-        // to guarantee computation
-        return heap.empty();
-    };
-
-    BENCHMARK("mixed") {
-        for (int i = 1; i <= reps / 4; ++i) {
-            heap.push(i * 3);
-            heap.push(i);
-            heap.push(i * 4);
-            heap.push(i * 2);
-            heap.pop();
-            heap.pop();
-            heap.pop();
-        }
-        for (int i = 1; i <= reps / 4; ++i) {
-            heap.pop();
-        }
-        // to guarantee computation
-        return heap.empty();
-    };
+    benchmark_workloads(heap);
 }
 #endif
 
@@ -138,58 +153,7 @@ TEMPLATE_TEST_CASE_SIG("Degree", "[benchmark][heap][degree]", ((unsigned int Deg
 
     auto heap = heap_t{};
 
-    BENCHMARK("up") {
-        for (int i = 1; i <= reps; ++i) {
-            heap.push(i);
-        }
-        for (int i = 1; i <= reps; ++i) {
-            heap.pop();
-        }
-        // to guarantee computation
-        return heap.empty();
-    };
-
-    BENCHMARK("down") {
-        for (int i = reps; i > 0; --i) {
-            heap.push(i);
-        }
-        for (int i = 1; i <= reps; ++i) {
-            heap.pop();
-        }
-        // to guarantee computation
-        return heap.empty();
-    };
-
-    BENCHMARK("up_down") {
-        for (int i = 1; i <= reps / 2; ++i) {
-            heap.push(i);
-        }
-        for (int i = reps; i > reps / 2; --i) {
-            heap.push(i);
-        }
-        for (int i = 1; i <= reps; ++i) {
-            heap.pop();
-        }
-        // to guarantee computation
-        return heap.empty();
-    };
-
-    BENCHMARK("mixed") {
-        for (int i = 1; i <= reps / 4; ++i) {
-            heap.push(i * 3);
-            heap.push(i);
-            heap.push(i * 4);
-            heap.push(i * 2);
-            heap.pop();
-            heap.pop();
-            heap.pop();
-        }
-        for (int i = 1; i <= reps / 4; ++i) {
-            heap.pop();
-        }
-        // to guarantee computation
-        return heap.empty();
-    };
+    benchmark_workloads(heap);
 }
 
 TEMPLATE_TEST_CASE_SIG("BufferedPQ", "[benchmark][buffered_pq]", ((unsigned int Buffersize), Buffersize), 4, 8, 16, 64,
@@ -198,58 +162,7 @@ TEMPLATE_TEST_CASE_SIG("BufferedPQ", "[benchmark][buffered_pq]", ((unsigned int
 
     auto pq = pq_t{};
 
-    BENCHMARK("up") {
-        for (int i = 1; i <= reps; ++i) {
-            pq.push(i);
-        }
-        for (int i = 1; i <= reps; ++i) {
-            pq.pop();
-        }
-        // to guarantee computation
-        return pq.empty();
-    };
-
-    BENCHMARK("down") {
-        for (int i = reps; i > 0; --i) {
-            pq.push(i);
-        }
-        for (int i = 1; i <= reps; ++i) {
-            pq.pop();
-        }
-        // to guarantee computation
-        return pq.empty();
-    };
-
-    BENCHMARK("up_down") {
-        for (int i = 1; i <= reps / 2; ++i) {
-            pq.push(i);
-        }
-        for (int i = reps; i > reps / 2; --i) {
-            pq.push(i);
-        }
-        for (int i = 1; i <= reps; ++i) {
-            pq.pop();
-        }
-        // to guarantee computation
-        return pq.empty();
-    };
-
-    BENCHMARK("mixed") {
-        for (int i = 1; i <= reps / 4; ++i) {
-            pq.push(i * 3);
-            pq.push(i);
-            pq.push(i * 4);
-            pq.push(i * 2);
-            pq.pop();
-            pq.pop();
-            pq.pop();
-        }
-        for (int i = 1; i <= reps / 4; ++i) {
-            pq.pop();
-        }
-        // to guarantee computation
-        return pq.empty();
-    };
+    benchmark_workloads(pq);
 }
 
 TEMPLATE_TEST_CASE_SIG("BufferedPQ std::pq", "[benchmark][buffered_pq]", ((unsigned int Buffersize), Buffersize), 4, 8,
@@ -259,56 +172,5 @@ TEMPLATE_TEST_CASE_SIG("BufferedPQ std::pq", "[benchmark][buffered_pq]", ((unsig
 
     auto pq = pq_t{};
 
-    BENCHMARK("up") {
-        for (int i = 1; i <= reps; ++i) {
-            pq.push(i);
-        }
-        for (int i = 1; i <= reps; ++i) {
-            pq.pop();
-        }
-        // to guarantee computation
-        return pq.empty();
-    };
-
-    BENCHMARK("down") {
-        for (int i = reps; i > 0; --i) {
-            pq.push(i);
-        }
-        for (int i = 1; i <= reps; ++i) {
-            pq.pop();
-        }
-        // to guarantee computation
-        return pq.empty();
-    };
-
-    BENCHMARK("up_down") {
-        for (int i = 1; i <= reps / 2; ++i) {
-            pq.push(i);
-        }
-        for (int i = reps; i > reps / 2; --i) {
-            pq.push(i);
-        }
-        for (int i = 1; i <= reps; ++i) {
-            pq.pop();
-        }
-        // to guarantee computation
-        return pq.empty();
-    };
-
-    BENCHMARK("mixed") {
-        for (int i = 1; i <= reps / 4; ++i) {
-            pq.push(i * 3);
-            pq.push(i);
-            pq.push(i * 4);
-            pq.push(i * 2);
-            pq.pop();
-            pq.pop();
-            pq.pop();
-        }
-        for (int i = 1; i <= reps / 4; ++i) {
-            pq.pop();
-        }
-        // to guarantee computation
-        return pq.empty();
-    };
+    benchmark_workloads(pq);
 }
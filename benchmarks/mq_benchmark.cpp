@@ -0,0 +1,489 @@
+#include "benchmark_utils.hpp"
+#include "perf_counters.hpp"
+#include "quality.hpp"
+
+#include "multiqueue/multiqueue.hpp"
+
+#include "pcg_random.hpp"
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using key_type = std::uint64_t;
+using clock_type = std::chrono::steady_clock;
+
+struct Settings {
+    unsigned num_threads = 4;
+    std::size_t factor = 4;
+    std::string mode = "random";
+    int pop_tries = 1;
+    bool scan = true;
+    std::string keys = "uniform";
+    std::size_t prefill = 1'000'000;
+    std::size_t ops_per_thread = 1'000'000;
+    std::size_t sample_interval = 64;
+    bool pin = false;
+    int seed = 1;
+    int stickiness = 16;
+    bool quality = false;
+    bool compare_stale = false;
+    bool perf = false;
+    std::string backoff = "none";
+    std::string layout = "packed";
+    std::size_t reserve = 0;
+};
+
+struct ThreadResult {
+    std::size_t pushes = 0;
+    std::size_t pops = 0;
+    std::size_t failed_pops = 0;
+    std::vector<std::uint64_t> push_latency;
+    std::vector<std::uint64_t> pop_latency;
+    std::vector<bench::quality::Event> events;
+    std::optional<bench::PerfCounters::Reading> perf;
+};
+
+// Random and hold keys are in [1, max_key]. Monotone keys start at max_key / 2, which leaves room to count in both
+// directions while every key stays far below the sentinel of the min-queue.
+constexpr key_type max_key = (key_type{1} << 32) - 1;
+constexpr key_type max_hold_increment = 100;
+
+void print_usage(char const *name) {
+    std::cerr << "Usage: " << name << " [options]\n"
+              << "  -j, --threads <n>       number of threads (default: 4)\n"
+              << "  -c, --factor <n>        queues per thread (default: 4)\n"
+              << "  -m, --mode <name>       one of " << bench::mode_names << " (default: random)\n"
+              << "  -t, --pop-tries <n>     1 or 2 (default: 1)\n"
+              << "  -S, --no-scan           disable the scan fallback of try_pop\n"
+              << "  -k, --keys <name>       uniform, monotone, hold or alternating (default: uniform)\n"
+              << "  -n, --prefill <n>       elements inserted before measuring (default: 1000000)\n"
+              << "  -o, --ops <n>           operations per thread (default: 1000000)\n"
+              << "  -i, --sample <n>        measure the latency of every n-th operation (default: 64)\n"
+              << "  -p, --pin               pin thread i to core i\n"
+              << "  -s, --seed <n>          random seed (default: 1)\n"
+              << "  -y, --stickiness <n>    stickiness of the sticky modes (default: 16)\n"
+              << "  -q, --quality           log all operations and report rank error and delay instead of throughput\n"
+              << "  -Q, --compare-stale     run mode::Random with pop_stale=true (random) and false (random_strict)\n"
+              << "  -P, --perf              report hardware performance counters per operation if available\n"
+              << "  -b, --backoff <name>    one of " << bench::backoff_names << " (default: none)\n"
+              << "  -L, --layout <name>     guard layout, one of " << bench::layout_names
+              << "; separate puts the top key\n"
+              << "                          on its own cache line, shadow mirrors all top keys into\n"
+              << "                          a dense array, mailbox lets failed pushes post to the queue,\n"
+              << "                          eliminate keeps pushes that beat the candidates in the handle\n"
+              << "                          (default: packed)\n"
+              << "  -r, --reserve <n>       reserve room for n elements in parallel on the worker threads\n"
+              << "                          (default: reserve room for the prefill on the main thread)\n"
+              << "  -h, --help              print this help\n";
+}
+
+bool parse_args(int argc, char **argv, Settings &settings) {
+    static option const long_options[] = {
+        {"threads", required_argument, nullptr, 'j'}, {"factor", required_argument, nullptr, 'c'},
+        {"mode", required_argument, nullptr, 'm'},    {"pop-tries", required_argument, nullptr, 't'},
+        {"no-scan", no_argument, nullptr, 'S'},       {"keys", required_argument, nullptr, 'k'},
+        {"prefill", required_argument, nullptr, 'n'}, {"ops", required_argument, nullptr, 'o'},
+        {"sample", required_argument, nullptr, 'i'},  {"pin", no_argument, nullptr, 'p'},
+        {"seed", required_argument, nullptr, 's'},    {"stickiness", required_argument, nullptr, 'y'},
+        {"quality", no_argument, nullptr, 'q'},       {"compare-stale", no_argument, nullptr, 'Q'},
+        {"perf", no_argument, nullptr, 'P'},          {"backoff", required_argument, nullptr, 'b'},
+        {"layout", required_argument, nullptr, 'L'},  {"reserve", required_argument, nullptr, 'r'},
+        {"help", no_argument, nullptr, 'h'},          {nullptr, 0, nullptr, 0}};
+    int c{};
+    while ((c = getopt_long(argc, argv, "j:c:m:t:Sk:n:o:i:ps:y:qQPb:L:r:h", long_options, nullptr)) != -1) {
+        switch (c) {
+            case 'j':
+                settings.num_threads = static_cast<unsigned>(std::stoul(optarg));
+                break;
+            case 'c':
+                settings.factor = std::stoul(optarg);
+                break;
+            case 'm':
+                settings.mode = optarg;
+                break;
+            case 't':
+                settings.pop_tries = std::stoi(optarg);
+                break;
+            case 'S':
+                settings.scan = false;
+                break;
+            case 'k':
+                settings.keys = optarg;
+                break;
+            case 'n':
+                settings.prefill = std::stoul(optarg);
+                break;
+            case 'o':
+                settings.ops_per_thread = std::stoul(optarg);
+                break;
+            case 'i':
+                settings.sample_interval = std::max(1UL, std::stoul(optarg));
+                break;
+            case 'p':
+                settings.pin = true;
+                break;
+            case 's':
+                settings.seed = std::stoi(optarg);
+                break;
+            case 'y':
+                settings.stickiness = std::stoi(optarg);
+                break;
+            case 'q':
+                settings.quality = true;
+                break;
+            case 'Q':
+                settings.compare_stale = true;
+                break;
+            case 'P':
+                settings.perf = true;
+                break;
+            case 'b':
+                settings.backoff = optarg;
+                break;
+            case 'L':
+                settings.layout = optarg;
+                break;
+            case 'r':
+                settings.reserve = std::stoul(optarg);
+                break;
+            default:
+                return false;
+        }
+    }
+    if (settings.num_threads == 0 || settings.factor == 0) {
+        std::cerr << "Number of threads and queue factor must be positive\n";
+        return false;
+    }
+    if (settings.keys != "uniform" && settings.keys != "monotone" && settings.keys != "hold" &&
+        settings.keys != "alternating") {
+        std::cerr << "Unknown key distribution: " << settings.keys << '\n';
+        return false;
+    }
+    return true;
+}
+
+std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now().time_since_epoch()).count();
+}
+
+// With `Record`, the queue stores (key, unique id) pairs and every operation is logged for the quality replay
+template <typename MultiQueue, bool Record>
+class Worker {
+    using handle_type = typename MultiQueue::handle_type;
+    using value_type = typename MultiQueue::value_type;
+
+    handle_type handle_;
+    Settings const &settings_;
+    unsigned id_;
+    pcg32 rng_;
+    std::uniform_int_distribution<key_type> key_dist_{1, max_key};
+    key_type next_monotone_;
+    std::uint64_t next_element_id_;
+    ThreadResult result_;
+
+    static key_type key_of(value_type const &v) noexcept {
+        if constexpr (Record) {
+            return v.first;
+        } else {
+            return v;
+        }
+    }
+
+    value_type make_value(key_type key) noexcept {
+        if constexpr (Record) {
+            return {key, next_element_id_++};
+        } else {
+            return key;
+        }
+    }
+
+    template <typename F>
+    void timed(std::size_t i, std::vector<std::uint64_t> &samples, F &&f) {
+        if (Record || i % settings_.sample_interval != 0) {
+            f();
+            return;
+        }
+        auto start = clock_type::now();
+        f();
+        auto end = clock_type::now();
+        samples.push_back(
+            static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+    }
+
+    void push(std::size_t i, key_type key) {
+        auto v = make_value(key);
+        if constexpr (Record) {
+            result_.events.push_back({now_ns(), v.first, v.second, false});
+        }
+        timed(i, result_.push_latency, [&] { handle_.push(v); });
+        ++result_.pushes;
+    }
+
+    std::optional<key_type> pop(std::size_t i) {
+        std::optional<value_type> v;
+        timed(i, result_.pop_latency, [&] { v = handle_.try_pop(); });
+        if (!v) {
+            ++result_.failed_pops;
+            return std::nullopt;
+        }
+        if constexpr (Record) {
+            result_.events.push_back({now_ns(), v->first, v->second, true});
+        }
+        ++result_.pops;
+        return key_of(*v);
+    }
+
+   public:
+    Worker(handle_type handle, Settings const &settings, unsigned id)
+        : handle_{std::move(handle)},
+          settings_{settings},
+          id_{id},
+          rng_{static_cast<std::uint64_t>(settings.seed), id},
+          next_monotone_{max_key / 2 + id},
+          next_element_id_{std::uint64_t{id} << 40} {
+        if constexpr (Record) {
+            result_.events.reserve(settings.ops_per_thread + settings.prefill / settings.num_threads + 1);
+        }
+    }
+
+    void prefill(std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            auto v = make_value(settings_.keys == "monotone" ? max_key / 2 - i * settings_.num_threads - id_
+                                                             : key_dist_(rng_));
+            if constexpr (Record) {
+                result_.events.push_back({0, v.first, v.second, false});
+            }
+            handle_.push(v);
+        }
+    }
+
+    void run() {
+        auto const &keys = settings_.keys;
+        std::size_t i = 0;
+        if (keys == "uniform") {
+            for (; i < settings_.ops_per_thread; ++i) {
+                if ((rng_() & 1U) == 0U) {
+                    push(i, key_dist_(rng_));
+                } else {
+                    pop(i);
+                }
+            }
+        } else if (keys == "alternating") {
+            for (; i < settings_.ops_per_thread; ++i) {
+                if (i % 2 == 0) {
+                    push(i, key_dist_(rng_));
+                } else {
+                    pop(i);
+                }
+            }
+        } else if (keys == "monotone") {
+            for (; i < settings_.ops_per_thread; ++i) {
+                if (i % 2 == 0) {
+                    push(i, next_monotone_);
+                    next_monotone_ += settings_.num_threads;
+                } else {
+                    pop(i);
+                }
+            }
+        } else {
+            // Hold model: every deleted element is reinserted with a slightly larger key
+            std::uniform_int_distribution<key_type> increment_dist{1, max_hold_increment};
+            for (; i < settings_.ops_per_thread; i += 2) {
+                auto v = pop(i);
+                auto key = v ? std::min(*v + increment_dist(rng_), max_key) : key_dist_(rng_);
+                push(i, key);
+            }
+        }
+    }
+
+    ThreadResult &result() noexcept {
+        return result_;
+    }
+};
+
+void write_settings(bench::JsonWriter &json, Settings const &settings, std::string const &mode) {
+    json.begin_object("settings")
+        .value("threads", settings.num_threads)
+        .value("factor", settings.factor)
+        .value("num_pqs", settings.factor * settings.num_threads)
+        .value("mode", mode)
+        .value("pop_tries", settings.pop_tries)
+        .value("scan", settings.scan)
+        .value("stickiness", settings.stickiness)
+        .value("keys", settings.keys)
+        .value("prefill", settings.prefill)
+        .value("ops_per_thread", settings.ops_per_thread)
+        .value("sample_interval", settings.sample_interval)
+        .value("pin", settings.pin)
+        .value("seed", settings.seed)
+        .value("perf", settings.perf)
+        .value("backoff", settings.backoff)
+        .value("layout", settings.layout)
+        .value("reserve", settings.reserve)
+        .value("oversubscription",
+               static_cast<double>(settings.num_threads) / static_cast<double>(std::thread::hardware_concurrency()))
+        .end_object();
+}
+
+template <typename Policy, bool Record>
+void run_benchmark(Settings const &settings, std::string const &mode) {
+    using mq_type = std::conditional_t<Record, multiqueue::KeyValueMultiQueue<key_type, std::uint64_t, std::greater<>, Policy>,
+                                       multiqueue::ValueMultiQueue<key_type, std::greater<>, Policy>>;
+    using worker_type = Worker<mq_type, Record>;
+
+    auto const num_pqs = settings.factor * settings.num_threads;
+    auto config = typename mq_type::config_type{};
+    config.seed = settings.seed;
+    bench::set_stickiness(config, settings.stickiness);
+    auto const init_start = clock_type::now();
+    mq_type mq(num_pqs, settings.reserve == 0 ? settings.prefill : 0, config);
+
+    bench::Barrier barrier{settings.num_threads + 1};
+    std::vector<ThreadResult> results(settings.num_threads);
+    std::vector<std::thread> threads;
+    threads.reserve(settings.num_threads);
+    for (unsigned id = 0; id < settings.num_threads; ++id) {
+        threads.emplace_back([&, id] {
+            if (settings.pin && !bench::pin_to_core(id)) {
+                std::cerr << "Could not pin thread " << id << '\n';
+            }
+            // Each worker touches the storage of its share of the queues first
+            if (settings.reserve != 0) {
+                mq.reserve(settings.reserve, id, settings.num_threads);
+            }
+            barrier.wait();
+            worker_type worker{mq.get_handle(), settings, id};
+            auto const n = settings.prefill / settings.num_threads +
+                (id < settings.prefill % settings.num_threads ? 1 : 0);
+            worker.prefill(n);
+            // Counters only see the calling thread, so every worker opens its own
+            std::optional<bench::PerfCounters> counters;
+            if (settings.perf) {
+                counters.emplace();
+            }
+            barrier.wait();
+            barrier.wait();
+            if (counters && counters->available()) {
+                worker.result().perf = bench::measure(*counters, [&] { worker.run(); });
+            } else {
+                worker.run();
+            }
+            barrier.wait();
+            results[id] = std::move(worker.result());
+        });
+    }
+    barrier.wait();
+    auto const init_end = clock_type::now();
+    barrier.wait();
+    auto start = clock_type::now();
+    barrier.wait();
+    barrier.wait();
+    auto end = clock_type::now();
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    ThreadResult total;
+    total.perf = results.front().perf;
+    for (auto &r : results) {
+        if (&r != &results.front()) {
+            if (total.perf && r.perf) {
+                *total.perf += *r.perf;
+            } else {
+                total.perf.reset();
+            }
+        }
+        total.pushes += r.pushes;
+        total.pops += r.pops;
+        total.failed_pops += r.failed_pops;
+        total.push_latency.insert(total.push_latency.end(), r.push_latency.begin(), r.push_latency.end());
+        total.pop_latency.insert(total.pop_latency.end(), r.pop_latency.begin(), r.pop_latency.end());
+        total.events.insert(total.events.end(), r.events.begin(), r.events.end());
+        r.events = {};
+    }
+    auto const seconds = std::chrono::duration<double>(end - start).count();
+    auto const ops = total.pushes + total.pops + total.failed_pops;
+
+    bench::JsonWriter json{std::cout};
+    json.begin_object();
+    json.value("benchmark", Record ? "quality" : "throughput");
+    write_settings(json, settings, mode);
+    json.value("init_time_s", std::chrono::duration<double>(init_end - init_start).count())
+        .value("time_s", seconds)
+        .value("ops", ops)
+        .value("ops_per_s", static_cast<double>(ops) / seconds)
+        .value("pushes", total.pushes)
+        .value("pops", total.pops)
+        .value("failed_pops", total.failed_pops);
+    if constexpr (Record) {
+        auto quality = bench::quality::replay(total.events);
+        json.percentiles("rank_error", bench::percentiles(quality.rank_errors))
+            .percentiles("delay", bench::percentiles(quality.delays));
+    } else {
+        json.begin_object("latency_ns")
+            .percentiles("push", bench::percentiles(total.push_latency))
+            .percentiles("pop", bench::percentiles(total.pop_latency))
+            .end_object();
+    }
+    if (settings.perf) {
+        if (total.perf) {
+            json.begin_object("perf_per_op");
+            for (std::size_t i = 0; i < bench::PerfCounters::num_events; ++i) {
+                if (total.perf->values[i]) {
+                    json.value(bench::PerfCounters::names[i],
+                               static_cast<double>(*total.perf->values[i]) / static_cast<double>(ops));
+                }
+            }
+            json.end_object();
+        } else {
+            std::cerr << "Performance counters unavailable, reporting time only\n";
+        }
+    }
+    json.end_object();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Settings settings;
+    if (!parse_args(argc, argv, settings)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    std::vector<std::string> modes{settings.mode};
+    if (settings.compare_stale) {
+        modes = {"random", "random_strict"};
+    }
+    for (auto const &mode : modes) {
+        if (!bench::dispatch_policy(mode, settings.pop_tries, settings.scan, settings.backoff, settings.layout, [&](auto tag) {
+                using policy_type = typename decltype(tag)::type;
+                if (settings.quality) {
+                    run_benchmark<policy_type, true>(settings, mode);
+                } else {
+                    run_benchmark<policy_type, false>(settings, mode);
+                }
+            })) {
+            std::cerr << "Unsupported combination of mode, pop tries, scan, backoff and layout\n";
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
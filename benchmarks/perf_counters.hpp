@@ -0,0 +1,170 @@
+#pragma once
+
+// Hardware performance counters of the calling thread via perf_event_open. Where perf events are unavailable (not
+// Linux, no permission, virtualized without a PMU), `available()` is false and all readings are empty, so callers fall
+// back to reporting time only.
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace bench {
+
+class PerfCounters {
+   public:
+    enum Event : std::size_t { cycles, instructions, l1d_misses, llc_misses, branch_misses, num_events };
+
+    static constexpr std::array<char const *, num_events> names = {"cycles", "instructions", "l1d_misses",
+                                                                    "llc_misses", "branch_misses"};
+
+    // Counter values, an event is missing if the hardware does not support it
+    struct Reading {
+        std::array<std::optional<std::uint64_t>, num_events> values{};
+
+        Reading &operator+=(Reading const &other) noexcept {
+            for (std::size_t i = 0; i < num_events; ++i) {
+                if (values[i] && other.values[i]) {
+                    *values[i] += *other.values[i];
+                } else {
+                    values[i].reset();
+                }
+            }
+            return *this;
+        }
+    };
+
+   private:
+    std::array<int, num_events> fds_{-1, -1, -1, -1, -1};
+    int leader_ = -1;
+
+#if defined(__linux__)
+    static perf_event_attr attributes(Event event) noexcept {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        switch (event) {
+            case cycles:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                break;
+            case instructions:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                break;
+            case l1d_misses:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                break;
+            case llc_misses:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CACHE_MISSES;
+                break;
+            default:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+                break;
+        }
+        return attr;
+    }
+#endif
+
+   public:
+    PerfCounters() noexcept {
+#if defined(__linux__)
+        for (std::size_t i = 0; i < num_events; ++i) {
+            auto attr = attributes(static_cast<Event>(i));
+            fds_[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader_, 0));
+            if (leader_ == -1) {
+                leader_ = fds_[i];
+                if (leader_ == -1) {
+                    // Without cycles there is no group to attach the other events to
+                    return;
+                }
+            }
+        }
+#endif
+    }
+
+    PerfCounters(PerfCounters const &) = delete;
+    PerfCounters &operator=(PerfCounters const &) = delete;
+
+    ~PerfCounters() {
+#if defined(__linux__)
+        for (auto fd : fds_) {
+            if (fd != -1) {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    [[nodiscard]] bool available() const noexcept {
+        return leader_ != -1;
+    }
+
+    void start() noexcept {
+#if defined(__linux__)
+        if (available()) {
+            ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+    }
+
+    Reading stop() noexcept {
+        Reading reading;
+#if defined(__linux__)
+        if (!available()) {
+            return reading;
+        }
+        ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        // Group format: the number of events, then the values in the order the events were opened
+        std::array<std::uint64_t, num_events + 1> buffer{};
+        if (read(leader_, buffer.data(), sizeof(buffer)) <= 0) {
+            return reading;
+        }
+        std::size_t next = 1;
+        for (std::size_t i = 0; i < num_events && next <= buffer[0]; ++i) {
+            if (fds_[i] != -1) {
+                reading.values[i] = buffer[next++];
+            }
+        }
+#endif
+        return reading;
+    }
+};
+
+// Runs `f` with counters of the calling thread enabled
+template <typename F>
+PerfCounters::Reading measure(PerfCounters &counters, F &&f) {
+    counters.start();
+    f();
+    return counters.stop();
+}
+
+// Writes "name=value/op" for every available event
+template <typename Stream>
+void print_per_op(Stream &out, PerfCounters::Reading const &reading, std::uint64_t ops) {
+    char const *separator = "";
+    for (std::size_t i = 0; i < PerfCounters::num_events; ++i) {
+        if (reading.values[i]) {
+            out << separator << PerfCounters::names[i] << '='
+                << static_cast<double>(*reading.values[i]) / static_cast<double>(ops == 0 ? 1 : ops);
+            separator = " ";
+        }
+    }
+}
+
+}  // namespace bench
@@ -0,0 +1,287 @@
+#include "benchmark_utils.hpp"
+
+#include "multiqueue/multiqueue.hpp"
+
+#include "pcg_random.hpp"
+
+#include <getopt.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// PHOLD: a fixed population of events hops between logical processes (LPs). Processing an event at simulation time t
+// schedules a new event at a random LP at time t + lookahead + an exponentially distributed delay. An event processed
+// at an LP that has already processed an event with a larger timestamp would cause a rollback in an optimistic
+// simulation and is counted as out of order.
+
+namespace {
+
+using timestamp_type = std::uint64_t;
+using lp_type = std::uint32_t;
+using clock_type = std::chrono::steady_clock;
+
+struct Settings {
+    unsigned num_threads = 4;
+    std::size_t factor = 4;
+    std::vector<std::string> modes{"random"};
+    int pop_tries = 1;
+    bool scan = true;
+    int stickiness = 16;
+    bool pin = false;
+    int seed = 1;
+    lp_type num_lps = 1024;
+    std::size_t population = 65536;
+    timestamp_type lookahead = 1;
+    double mean_delay = 100.0;
+    timestamp_type end_time = 10000;
+};
+
+void print_usage(char const *name) {
+    std::cerr << "Usage: " << name << " [options]\n"
+              << "  -j, --threads <n>      number of threads (default: 4)\n"
+              << "  -c, --factor <n>       queues per thread (default: 4)\n"
+              << "  -m, --modes <list>     comma separated list of " << bench::mode_names << " (default: random)\n"
+              << "  -t, --pop-tries <n>    1 or 2 (default: 1)\n"
+              << "  -S, --no-scan          disable the scan fallback of try_pop\n"
+              << "  -y, --stickiness <n>   stickiness of the sticky modes (default: 16)\n"
+              << "  -p, --pin              pin thread i to core i\n"
+              << "  -s, --seed <n>         random seed (default: 1)\n"
+              << "  -l, --lps <n>          number of logical processes (default: 1024)\n"
+              << "  -e, --population <n>   number of events in flight (default: 65536)\n"
+              << "  -a, --lookahead <n>    minimum timestamp increment (default: 1)\n"
+              << "  -d, --delay <x>        mean of the exponential timestamp increment (default: 100)\n"
+              << "  -T, --end-time <n>     simulation end time (default: 10000)\n"
+              << "  -h, --help             print this help\n";
+}
+
+bool parse_args(int argc, char **argv, Settings &settings) {
+    static option const long_options[] = {
+        {"threads", required_argument, nullptr, 'j'},    {"factor", required_argument, nullptr, 'c'},
+        {"modes", required_argument, nullptr, 'm'},      {"pop-tries", required_argument, nullptr, 't'},
+        {"no-scan", no_argument, nullptr, 'S'},          {"stickiness", required_argument, nullptr, 'y'},
+        {"pin", no_argument, nullptr, 'p'},              {"seed", required_argument, nullptr, 's'},
+        {"lps", required_argument, nullptr, 'l'},        {"population", required_argument, nullptr, 'e'},
+        {"lookahead", required_argument, nullptr, 'a'},  {"delay", required_argument, nullptr, 'd'},
+        {"end-time", required_argument, nullptr, 'T'},   {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+    int c{};
+    while ((c = getopt_long(argc, argv, "j:c:m:t:Sy:ps:l:e:a:d:T:h", long_options, nullptr)) != -1) {
+        switch (c) {
+            case 'j':
+                settings.num_threads = static_cast<unsigned>(std::stoul(optarg));
+                break;
+            case 'c':
+                settings.factor = std::stoul(optarg);
+                break;
+            case 'm':
+                settings.modes = bench::split(optarg, ',');
+                break;
+            case 't':
+                settings.pop_tries = std::stoi(optarg);
+                break;
+            case 'S':
+                settings.scan = false;
+                break;
+            case 'y':
+                settings.stickiness = std::stoi(optarg);
+                break;
+            case 'p':
+                settings.pin = true;
+                break;
+            case 's':
+                settings.seed = std::stoi(optarg);
+                break;
+            case 'l':
+                settings.num_lps = static_cast<lp_type>(std::stoul(optarg));
+                break;
+            case 'e':
+                settings.population = std::stoul(optarg);
+                break;
+            case 'a':
+                settings.lookahead = std::stoull(optarg);
+                break;
+            case 'd':
+                settings.mean_delay = std::stod(optarg);
+                break;
+            case 'T':
+                settings.end_time = std::stoull(optarg);
+                break;
+            default:
+                return false;
+        }
+    }
+    if (settings.num_threads == 0 || settings.factor == 0 || settings.num_lps == 0 || settings.mean_delay <= 0.0) {
+        std::cerr << "Number of threads, queue factor, number of LPs and mean delay must be positive\n";
+        return false;
+    }
+    return true;
+}
+
+struct ThreadCounts {
+    std::size_t events = 0;
+    std::size_t out_of_order = 0;
+    std::size_t failed_pops = 0;
+};
+
+class EventGenerator {
+    pcg32 rng_;
+    std::uniform_int_distribution<lp_type> lp_dist_;
+    std::exponential_distribution<double> delay_dist_;
+    timestamp_type lookahead_;
+
+   public:
+    EventGenerator(Settings const &settings, std::uint64_t stream)
+        : rng_{static_cast<std::uint64_t>(settings.seed), stream},
+          lp_dist_{0, settings.num_lps - 1},
+          delay_dist_{1.0 / settings.mean_delay},
+          lookahead_{settings.lookahead} {
+    }
+
+    std::pair<timestamp_type, lp_type> next(timestamp_type now) {
+        return {now + lookahead_ + static_cast<timestamp_type>(delay_dist_(rng_)), lp_dist_(rng_)};
+    }
+};
+
+template <typename Policy>
+void run_simulation(Settings const &settings, std::string const &mode) {
+    using mq_type = multiqueue::KeyValueMultiQueue<timestamp_type, lp_type, std::greater<>, Policy>;
+
+    auto config = typename mq_type::config_type{};
+    config.seed = settings.seed;
+    bench::set_stickiness(config, settings.stickiness);
+    mq_type mq(settings.factor * settings.num_threads, settings.population, config);
+
+    // The timestamp of the latest event processed at each LP
+    std::vector<std::atomic<timestamp_type>> lp_time(settings.num_lps);
+    for (auto &t : lp_time) {
+        t.store(0, std::memory_order_relaxed);
+    }
+    // Events beyond the end time are not rescheduled, the simulation ends when no event is left
+    std::atomic_size_t live_events{settings.population};
+
+    bench::Barrier barrier{settings.num_threads + 1};
+    std::vector<ThreadCounts> counts(settings.num_threads);
+    std::vector<std::thread> threads;
+    threads.reserve(settings.num_threads);
+    for (unsigned id = 0; id < settings.num_threads; ++id) {
+        threads.emplace_back([&, id] {
+            if (settings.pin && !bench::pin_to_core(id)) {
+                std::cerr << "Could not pin thread " << id << '\n';
+            }
+            auto handle = mq.get_handle();
+            EventGenerator generator{settings, id};
+            for (std::size_t i = id; i < settings.population; i += settings.num_threads) {
+                handle.push(generator.next(0));
+            }
+            ThreadCounts local;
+            barrier.wait();
+            barrier.wait();
+            while (true) {
+                auto event = handle.try_pop();
+                if (!event) {
+                    ++local.failed_pops;
+                    if (live_events.load(std::memory_order_acquire) == 0) {
+                        break;
+                    }
+                    continue;
+                }
+                auto [now, lp] = *event;
+                ++local.events;
+                auto last = lp_time[lp].load(std::memory_order_relaxed);
+                if (now < last) {
+                    ++local.out_of_order;
+                } else {
+                    while (last < now &&
+                           !lp_time[lp].compare_exchange_weak(last, now, std::memory_order_relaxed)) {
+                    }
+                }
+                auto next = generator.next(now);
+                if (next.first <= settings.end_time) {
+                    handle.push(next);
+                } else {
+                    live_events.fetch_sub(1, std::memory_order_release);
+                }
+            }
+            barrier.wait();
+            counts[id] = local;
+        });
+    }
+    barrier.wait();
+    auto start = clock_type::now();
+    barrier.wait();
+    barrier.wait();
+    auto end = clock_type::now();
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    ThreadCounts total;
+    for (auto const &c : counts) {
+        total.events += c.events;
+        total.out_of_order += c.out_of_order;
+        total.failed_pops += c.failed_pops;
+    }
+    // Every out of order event is assumed to be rolled back
+    auto const committed = total.events - total.out_of_order;
+    auto const seconds = std::chrono::duration<double>(end - start).count();
+
+    bench::JsonWriter json{std::cout};
+    json.begin_object();
+    json.value("benchmark", "phold");
+    json.begin_object("settings")
+        .value("threads", settings.num_threads)
+        .value("factor", settings.factor)
+        .value("num_pqs", settings.factor * settings.num_threads)
+        .value("mode", mode)
+        .value("pop_tries", settings.pop_tries)
+        .value("scan", settings.scan)
+        .value("stickiness", settings.stickiness)
+        .value("pin", settings.pin)
+        .value("seed", settings.seed)
+        .value("lps", settings.num_lps)
+        .value("population", settings.population)
+        .value("lookahead", settings.lookahead)
+        .value("mean_delay", settings.mean_delay)
+        .value("end_time", settings.end_time)
+        .end_object();
+    json.value("time_s", seconds)
+        .value("events", total.events)
+        .value("committed_events", committed)
+        .value("out_of_order_events", total.out_of_order)
+        .value("out_of_order_rate",
+               total.events == 0 ? 0.0 : static_cast<double>(total.out_of_order) / static_cast<double>(total.events))
+        .value("failed_pops", total.failed_pops)
+        .value("events_per_s", static_cast<double>(total.events) / seconds)
+        .value("committed_events_per_s", static_cast<double>(committed) / seconds);
+    json.end_object();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Settings settings;
+    if (!parse_args(argc, argv, settings)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    for (auto const &mode : settings.modes) {
+        if (!bench::dispatch_policy(mode, settings.pop_tries, settings.scan, [&](auto tag) {
+                run_simulation<typename decltype(tag)::type>(settings, mode);
+            })) {
+            std::cerr << "Unsupported combination of mode " << mode << " and pop tries\n";
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
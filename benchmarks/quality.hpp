@@ -0,0 +1,69 @@
+#pragma once
+
+// Replay of logged operations against an exact priority queue to measure the rank error and delay of a relaxed
+// priority queue. Smaller keys are assumed to have higher priority.
+
+#include <ext/pb_ds/assoc_container.hpp>
+#include <ext/pb_ds/tree_policy.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace bench::quality {
+
+struct Event {
+    // Pushes are stamped before and pops after the operation, so every element is pushed before it is popped
+    std::int64_t time;
+    std::uint64_t key;
+    std::uint64_t id;
+    bool is_pop;
+};
+
+struct Result {
+    // The number of elements with strictly smaller key present when an element was popped
+    std::vector<std::uint64_t> rank_errors;
+    // The number of worse elements popped while an element was the exact minimum
+    std::vector<std::uint64_t> delays;
+};
+
+inline Result replay(std::vector<Event> &events) {
+    using element_type = std::pair<std::uint64_t, std::uint64_t>;
+    using tree_type = __gnu_pbds::tree<element_type, __gnu_pbds::null_type, std::less<>, __gnu_pbds::rb_tree_tag,
+                                       __gnu_pbds::tree_order_statistics_node_update>;
+
+    std::sort(events.begin(), events.end(), [](Event const &lhs, Event const &rhs) {
+        return std::tie(lhs.time, lhs.is_pop) < std::tie(rhs.time, rhs.is_pop);
+    });
+    Result result;
+    tree_type exact;
+    std::unordered_map<std::uint64_t, std::uint64_t> top_delay;
+    for (auto const &e : events) {
+        if (!e.is_pop) {
+            exact.insert({e.key, e.id});
+            continue;
+        }
+        assert(exact.find({e.key, e.id}) != exact.end());
+        auto const &top = *exact.begin();
+        if (top.first < e.key) {
+            ++top_delay[top.second];
+        }
+        result.rank_errors.push_back(exact.order_of_key({e.key, 0}));
+        auto it = top_delay.find(e.id);
+        if (it != top_delay.end()) {
+            result.delays.push_back(it->second);
+            top_delay.erase(it);
+        } else {
+            result.delays.push_back(0);
+        }
+        exact.erase({e.key, e.id});
+    }
+    return result;
+}
+
+}  // namespace bench::quality
@@ -0,0 +1,367 @@
+#include "benchmark_utils.hpp"
+#include "graph.hpp"
+
+#include "multiqueue/multiqueue.hpp"
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <queue>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using bench::graph::Graph;
+using bench::graph::node_type;
+using distance_type = std::uint64_t;
+using clock_type = std::chrono::steady_clock;
+
+// The maximum is the sentinel of the min-queue
+constexpr distance_type unreachable = std::numeric_limits<distance_type>::max() - 1;
+
+struct Settings {
+    unsigned num_threads = 4;
+    std::size_t factor = 4;
+    std::vector<std::string> modes{"random"};
+    int pop_tries = 1;
+    bool scan = true;
+    int stickiness = 16;
+    bool pin = false;
+    int seed = 1;
+    std::string graph_type = "grid";
+    std::string graph_arg = "1000x1000";
+    bench::graph::weight_type max_weight = 255;
+    node_type source = 0;
+};
+
+void print_usage(char const *name) {
+    std::cerr << "Usage: " << name << " [options]\n"
+              << "  -j, --threads <n>        number of threads (default: 4)\n"
+              << "  -c, --factor <n>         queues per thread (default: 4)\n"
+              << "  -m, --modes <list>       comma separated list of " << bench::mode_names << " (default: random)\n"
+              << "  -t, --pop-tries <n>      1 or 2 (default: 1)\n"
+              << "  -S, --no-scan            disable the scan fallback of try_pop\n"
+              << "  -y, --stickiness <n>     stickiness of the sticky modes (default: 16)\n"
+              << "  -p, --pin                pin thread i to core i\n"
+              << "  -s, --seed <n>           random seed (default: 1)\n"
+              << "  -d, --dimacs <file>      read a DIMACS shortest path graph\n"
+              << "  -e, --edges <file>       read an edge list\n"
+              << "  -g, --grid <w>x<h>       generate a grid graph (default: 1000x1000)\n"
+              << "  -r, --rmat <scale>[:<f>] generate an R-MAT graph with 2^scale nodes and f*2^scale edges\n"
+              << "  -G, --geometric <n>[:<d>] generate a random geometric graph with expected degree d\n"
+              << "  -w, --max-weight <n>     maximum weight of generated edges (default: 255)\n"
+              << "  -o, --source <n>         source node (default: 0)\n"
+              << "  -h, --help               print this help\n";
+}
+
+bool parse_args(int argc, char **argv, Settings &settings) {
+    static option const long_options[] = {
+        {"threads", required_argument, nullptr, 'j'},   {"factor", required_argument, nullptr, 'c'},
+        {"modes", required_argument, nullptr, 'm'},     {"pop-tries", required_argument, nullptr, 't'},
+        {"no-scan", no_argument, nullptr, 'S'},         {"stickiness", required_argument, nullptr, 'y'},
+        {"pin", no_argument, nullptr, 'p'},             {"seed", required_argument, nullptr, 's'},
+        {"dimacs", required_argument, nullptr, 'd'},    {"edges", required_argument, nullptr, 'e'},
+        {"grid", required_argument, nullptr, 'g'},      {"rmat", required_argument, nullptr, 'r'},
+        {"geometric", required_argument, nullptr, 'G'}, {"max-weight", required_argument, nullptr, 'w'},
+        {"source", required_argument, nullptr, 'o'},    {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+    int c{};
+    while ((c = getopt_long(argc, argv, "j:c:m:t:Sy:ps:d:e:g:r:G:w:o:h", long_options, nullptr)) != -1) {
+        switch (c) {
+            case 'j':
+                settings.num_threads = static_cast<unsigned>(std::stoul(optarg));
+                break;
+            case 'c':
+                settings.factor = std::stoul(optarg);
+                break;
+            case 'm':
+                settings.modes = bench::split(optarg, ',');
+                break;
+            case 't':
+                settings.pop_tries = std::stoi(optarg);
+                break;
+            case 'S':
+                settings.scan = false;
+                break;
+            case 'y':
+                settings.stickiness = std::stoi(optarg);
+                break;
+            case 'p':
+                settings.pin = true;
+                break;
+            case 's':
+                settings.seed = std::stoi(optarg);
+                break;
+            case 'd':
+                settings.graph_type = "dimacs";
+                settings.graph_arg = optarg;
+                break;
+            case 'e':
+                settings.graph_type = "edges";
+                settings.graph_arg = optarg;
+                break;
+            case 'g':
+                settings.graph_type = "grid";
+                settings.graph_arg = optarg;
+                break;
+            case 'r':
+                settings.graph_type = "rmat";
+                settings.graph_arg = optarg;
+                break;
+            case 'G':
+                settings.graph_type = "geometric";
+                settings.graph_arg = optarg;
+                break;
+            case 'w':
+                settings.max_weight = static_cast<bench::graph::weight_type>(std::stoul(optarg));
+                break;
+            case 'o':
+                settings.source = static_cast<node_type>(std::stoul(optarg));
+                break;
+            default:
+                return false;
+        }
+    }
+    if (settings.num_threads == 0 || settings.factor == 0 || settings.max_weight == 0) {
+        std::cerr << "Number of threads, queue factor and maximum weight must be positive\n";
+        return false;
+    }
+    return true;
+}
+
+Graph build_graph(Settings const &settings) {
+    auto const seed = static_cast<std::uint64_t>(settings.seed);
+    if (settings.graph_type == "dimacs") {
+        return bench::graph::read_dimacs(settings.graph_arg);
+    }
+    if (settings.graph_type == "edges") {
+        return bench::graph::read_edge_list(settings.graph_arg);
+    }
+    if (settings.graph_type == "grid") {
+        auto dims = bench::split(settings.graph_arg, 'x');
+        auto width = std::stoul(dims.front());
+        auto height = dims.size() > 1 ? std::stoul(dims[1]) : width;
+        return bench::graph::generate_grid(width, height, settings.max_weight, seed);
+    }
+    auto params = bench::split(settings.graph_arg, ':');
+    if (settings.graph_type == "rmat") {
+        auto edge_factor = params.size() > 1 ? std::stoul(params[1]) : 16UL;
+        return bench::graph::generate_rmat(static_cast<unsigned>(std::stoul(params.front())), edge_factor,
+                                           settings.max_weight, seed);
+    }
+    auto degree = params.size() > 1 ? std::stod(params[1]) : 8.0;
+    return bench::graph::generate_geometric(std::stoul(params.front()), degree, settings.max_weight, seed);
+}
+
+struct SequentialResult {
+    std::vector<distance_type> distances;
+    std::size_t pops = 0;
+    double seconds = 0.0;
+};
+
+SequentialResult dijkstra(Graph const &graph, node_type source) {
+    SequentialResult result;
+    result.distances.assign(graph.num_nodes(), unreachable);
+    auto start = clock_type::now();
+    using entry_type = std::pair<distance_type, node_type>;
+    std::priority_queue<entry_type, std::vector<entry_type>, std::greater<>> pq;
+    result.distances[source] = 0;
+    pq.push({0, source});
+    while (!pq.empty()) {
+        auto [d, u] = pq.top();
+        pq.pop();
+        ++result.pops;
+        if (d > result.distances[u]) {
+            continue;
+        }
+        graph.for_each_neighbor(u, [&](auto n) {
+            auto nd = d + n.weight;
+            if (nd < result.distances[n.target]) {
+                result.distances[n.target] = nd;
+                pq.push({nd, n.target});
+            }
+        });
+    }
+    result.seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+    return result;
+}
+
+struct ThreadCounts {
+    std::size_t pops = 0;
+    std::size_t stale_pops = 0;
+    std::size_t failed_pops = 0;
+    std::size_t relaxations = 0;
+};
+
+template <typename Policy>
+void run_parallel(Settings const &settings, std::string const &mode, Graph const &graph,
+                  SequentialResult const &reference) {
+    using mq_type = multiqueue::KeyValueMultiQueue<distance_type, node_type, std::greater<>, Policy>;
+
+    auto config = typename mq_type::config_type{};
+    config.seed = settings.seed;
+    bench::set_stickiness(config, settings.stickiness);
+    mq_type mq(settings.factor * settings.num_threads, config);
+
+    std::vector<std::atomic<distance_type>> distances(graph.num_nodes());
+    for (auto &d : distances) {
+        d.store(unreachable, std::memory_order_relaxed);
+    }
+    // Counts the elements pushed but not completely processed, the search terminates when it drops to zero
+    std::atomic_size_t in_flight{1};
+    distances[settings.source].store(0, std::memory_order_relaxed);
+    mq.get_handle().push({0, settings.source});
+
+    bench::Barrier barrier{settings.num_threads + 1};
+    std::vector<ThreadCounts> counts(settings.num_threads);
+    std::vector<std::thread> threads;
+    threads.reserve(settings.num_threads);
+    for (unsigned id = 0; id < settings.num_threads; ++id) {
+        threads.emplace_back([&, id] {
+            if (settings.pin && !bench::pin_to_core(id)) {
+                std::cerr << "Could not pin thread " << id << '\n';
+            }
+            auto handle = mq.get_handle();
+            ThreadCounts local;
+            barrier.wait();
+            while (true) {
+                auto v = handle.try_pop();
+                if (!v) {
+                    ++local.failed_pops;
+                    if (in_flight.load(std::memory_order_acquire) == 0) {
+                        break;
+                    }
+                    continue;
+                }
+                ++local.pops;
+                auto [d, u] = *v;
+                if (d > distances[u].load(std::memory_order_relaxed)) {
+                    ++local.stale_pops;
+                    in_flight.fetch_sub(1, std::memory_order_release);
+                    continue;
+                }
+                graph.for_each_neighbor(u, [&](auto n) {
+                    auto const nd = d + n.weight;
+                    auto old = distances[n.target].load(std::memory_order_relaxed);
+                    while (nd < old) {
+                        if (distances[n.target].compare_exchange_weak(old, nd, std::memory_order_relaxed)) {
+                            ++local.relaxations;
+                            in_flight.fetch_add(1, std::memory_order_relaxed);
+                            handle.push({nd, n.target});
+                            break;
+                        }
+                    }
+                });
+                in_flight.fetch_sub(1, std::memory_order_release);
+            }
+            barrier.wait();
+            counts[id] = local;
+        });
+    }
+    barrier.wait();
+    auto start = clock_type::now();
+    barrier.wait();
+    auto end = clock_type::now();
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    ThreadCounts total;
+    for (auto const &c : counts) {
+        total.pops += c.pops;
+        total.stale_pops += c.stale_pops;
+        total.failed_pops += c.failed_pops;
+        total.relaxations += c.relaxations;
+    }
+    std::size_t wrong = 0;
+    for (std::size_t i = 0; i < graph.num_nodes(); ++i) {
+        if (distances[i].load(std::memory_order_relaxed) != reference.distances[i]) {
+            ++wrong;
+        }
+    }
+    std::size_t const settled = total.pops - total.stale_pops;
+    std::size_t const reached = static_cast<std::size_t>(
+        std::count_if(reference.distances.begin(), reference.distances.end(),
+                      [](distance_type d) { return d != unreachable; }));
+    auto const seconds = std::chrono::duration<double>(end - start).count();
+
+    bench::JsonWriter json{std::cout};
+    json.begin_object();
+    json.value("benchmark", "sssp");
+    json.begin_object("settings")
+        .value("threads", settings.num_threads)
+        .value("factor", settings.factor)
+        .value("num_pqs", settings.factor * settings.num_threads)
+        .value("mode", mode)
+        .value("pop_tries", settings.pop_tries)
+        .value("scan", settings.scan)
+        .value("stickiness", settings.stickiness)
+        .value("pin", settings.pin)
+        .value("seed", settings.seed)
+        .end_object();
+    json.begin_object("graph")
+        .value("type", settings.graph_type)
+        .value("argument", settings.graph_arg)
+        .value("nodes", graph.num_nodes())
+        .value("edges", graph.num_edges())
+        .value("source", settings.source)
+        .value("reached", reached)
+        .end_object();
+    json.value("correct", wrong == 0)
+        .value("wrong_distances", wrong)
+        .value("time_s", seconds)
+        .value("sequential_time_s", reference.seconds)
+        .value("speedup", reference.seconds / seconds)
+        .value("pops", total.pops)
+        .value("sequential_pops", reference.pops)
+        .value("failed_pops", total.failed_pops)
+        .value("stale_pops", total.stale_pops)
+        .value("relaxations", total.relaxations)
+        // Nodes settled more than once, because they were processed before their final distance was known
+        .value("wasted_relaxations", settled - std::min(settled, reached))
+        .value("pops_per_s", static_cast<double>(total.pops) / seconds);
+    json.end_object();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Settings settings;
+    if (!parse_args(argc, argv, settings)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    Graph graph;
+    try {
+        graph = build_graph(settings);
+    } catch (std::exception const &e) {
+        std::cerr << "Could not build graph: " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    if (settings.source >= graph.num_nodes()) {
+        std::cerr << "Source node " << settings.source << " is out of range\n";
+        return EXIT_FAILURE;
+    }
+    auto const reference = dijkstra(graph, settings.source);
+    for (auto const &mode : settings.modes) {
+        if (!bench::dispatch_policy(mode, settings.pop_tries, settings.scan, [&](auto tag) {
+                run_parallel<typename decltype(tag)::type>(settings, mode, graph, reference);
+            })) {
+            std::cerr << "Unsupported combination of mode " << mode << " and pop tries\n";
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "multiqueue/utils.hpp"
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <thread>
+
+// Backoff policies selected by `Policy::backoff_type`. A retry loop default-constructs one backoff object per operation
+// and calls `wait(guard)` after every failed lock attempt, passing the guard it failed to lock. Policies with `parks`
+// set block until that guard is unlocked, which requires the guards to wake parked threads (see ParkingPQGuard).
+
+namespace multiqueue::backoff {
+
+// Retry immediately
+struct None {
+    static constexpr bool parks = false;
+
+    template <typename Guard>
+    constexpr void wait(Guard const & /*guard*/) noexcept {
+    }
+};
+
+template <unsigned spins = 16>
+struct Pause {
+    static constexpr bool parks = false;
+
+    template <typename Guard>
+    void wait(Guard const & /*guard*/) noexcept {
+        for (unsigned i = 0; i < spins; ++i) {
+            utils::pause();
+        }
+    }
+};
+
+// Doubles the number of pauses with every failed attempt
+template <unsigned min_spins = 4, unsigned max_spins = 1024>
+class Exponential {
+    static_assert(min_spins > 0 && min_spins <= max_spins);
+    unsigned spins_ = min_spins;
+
+   public:
+    static constexpr bool parks = false;
+
+    template <typename Guard>
+    void wait(Guard const & /*guard*/) noexcept {
+        for (unsigned i = 0; i < spins_; ++i) {
+            utils::pause();
+        }
+        spins_ = std::min(2 * spins_, max_spins);
+    }
+};
+
+struct Yield {
+    static constexpr bool parks = false;
+
+    template <typename Guard>
+    void wait(Guard const & /*guard*/) noexcept {
+        std::this_thread::yield();
+    }
+};
+
+// Spins exponentially for the first `spin_rounds` failed attempts, then sleeps on the lock of the guard until it is
+// unlocked or `timeout_us` passed. The timeout bounds the cost of a missed wakeup.
+template <unsigned spin_rounds = 4, unsigned timeout_us = 100>
+class Park {
+    Exponential<> spin_;
+    unsigned round_ = 0;
+
+   public:
+    static constexpr bool parks = true;
+
+    template <typename Guard>
+    void wait(Guard &guard) noexcept {
+        if (round_ < spin_rounds) {
+            ++round_;
+            spin_.wait(guard);
+            return;
+        }
+        guard.park(std::chrono::microseconds{timeout_us});
+    }
+};
+
+// Blocks until the lock of `guard` is acquired
+template <typename Guard, typename Backoff>
+void lock(Guard &guard, Backoff &&backoff) noexcept {
+    while (!guard.try_lock()) {
+        backoff.wait(guard);
+    }
+}
+
+// Blocks while `word` holds `expected`, at most for `timeout`. Without futexes, this yields once.
+inline void futex_wait(std::atomic_uint32_t &word, std::uint32_t expected, std::chrono::nanoseconds timeout) noexcept {
+#if defined(__linux__)
+    auto const ns = timeout.count();
+    timespec ts{static_cast<std::time_t>(ns / 1'000'000'000), static_cast<long>(ns % 1'000'000'000)};
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAIT_PRIVATE, expected, &ts, nullptr, 0);
+#else
+    (void)word;
+    (void)expected;
+    (void)timeout;
+    std::this_thread::yield();
+#endif
+}
+
+inline void futex_wake_all(std::atomic_uint32_t &word) noexcept {
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#else
+    (void)word;
+#endif
+}
+
+}  // namespace multiqueue::backoff
@@ -10,12 +10,16 @@
 
 #pragma once
 
+#include "multiqueue/stats.hpp"
+
 #include <algorithm>
 #include <array>
 #include <cassert>
 #include <cstddef>
+#include <iterator>
 #include <memory>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <utility>
 
@@ -32,6 +36,8 @@ class BufferedPQ {
     using reference = typename priority_queue_type::reference;
     using const_reference = typename priority_queue_type::const_reference;
     using size_type = std::size_t;
+    // The deletion buffer, the insertion buffer and the heap array, each as pointer and size
+    using parts_type = std::array<std::pair<value_type const*, size_type>, 3>;
 
    private:
     using insertion_buffer_type = std::array<value_type, insertion_buffer_size>;
@@ -47,6 +53,21 @@ class BufferedPQ {
         void reserve(size_type new_cap) {
             priority_queue_type::c.reserve(new_cap);
         }
+
+        void reserve_touched(size_type new_cap) {
+            auto const size = priority_queue_type::c.size();
+            priority_queue_type::c.reserve(new_cap);
+            priority_queue_type::c.resize(std::max(size, new_cap));
+            priority_queue_type::c.resize(size);
+        }
+
+        size_type capacity() const noexcept {
+            return priority_queue_type::c.capacity();
+        }
+
+        void shrink_to_fit() {
+            priority_queue_type::c.shrink_to_fit();
+        }
     };
 
     size_type deletion_end_ = 0;
@@ -75,6 +96,18 @@ class BufferedPQ {
         }
     }
 
+    // The counting overloads below predict the flush and refill from the buffers and then call the plain operations,
+    // so that queues used without counters run the same code as before counters existed
+    template <typename Stats>
+    void count_refill(Stats& stats) const noexcept {
+        if (insertion_end_ != 0) {
+            stats.add(stats::Counter::buffer_flushes);
+        }
+        if (insertion_end_ + pq_.size() != 0) {
+            stats.add(stats::Counter::buffer_refills);
+        }
+    }
+
    public:
     explicit BufferedPQ(value_compare const& compare = value_compare()) : pq_(compare) {
     }
@@ -87,6 +120,13 @@ class BufferedPQ {
     explicit BufferedPQ(Alloc const& alloc) : pq_(alloc) {
     }
 
+    template <typename Alloc, typename = std::enable_if_t<std::uses_allocator_v<priority_queue_type, Alloc>>>
+    BufferedPQ(BufferedPQ const& other, Alloc const& alloc)
+        : deletion_end_{other.deletion_end_}, insertion_end_{other.insertion_end_}, pq_(other.pq_, alloc) {
+        std::copy_n(other.deletion_buffer_.begin(), deletion_end_, deletion_buffer_.begin());
+        std::copy_n(other.insertion_buffer_.begin(), insertion_end_, insertion_buffer_.begin());
+    }
+
     [[nodiscard]] constexpr bool empty() const {
         assert(deletion_end_ != 0 || (insertion_end_ == 0 && pq_.empty()));
         return deletion_end_ == 0;
@@ -109,6 +149,46 @@ class BufferedPQ {
         }
     }
 
+    template <typename Stats>
+    void pop(Stats& stats) {
+        if (deletion_end_ == 1) {
+            count_refill(stats);
+        }
+        pop();
+    }
+
+    // Moves up to `max_count` elements to `out`, best first, as long as `pred` holds for the top element. The run of
+    // the sorted deletion buffer satisfying `pred` is moved at once, and the buffer is refilled whenever it runs empty.
+    // Returns the number of moved elements.
+    template <typename Predicate, typename OutputIt>
+    size_type pop_while(Predicate pred, size_type max_count, OutputIt out) {
+        stats::None stats;
+        return pop_while(pred, max_count, out, stats);
+    }
+
+    template <typename Predicate, typename OutputIt, typename Stats>
+    size_type pop_while(Predicate pred, size_type max_count, OutputIt out, Stats& stats) {
+        size_type count = 0;
+        while (deletion_end_ != 0 && count < max_count) {
+            // The best element is at the back of the deletion buffer
+            auto const first = std::make_reverse_iterator(deletion_buffer_.begin() + deletion_end_);
+            auto const last = first + static_cast<std::ptrdiff_t>(std::min(deletion_end_, max_count - count));
+            auto const run_end = std::find_if_not(first, last, pred);
+            auto const n = static_cast<size_type>(run_end - first);
+            out = std::move(first, run_end, out);
+            count += n;
+            deletion_end_ -= n;
+            if (run_end != last) {
+                break;
+            }
+            if (deletion_end_ == 0) {
+                count_refill(stats);
+                refill_deletion_buffer();
+            }
+        }
+        return count;
+    }
+
     void push(const_reference value) {
         if (deletion_end_ > 0 && !pq_.compare(value, deletion_buffer_[0])) {
             size_type slot = deletion_end_ - 1;
@@ -147,9 +227,71 @@ class BufferedPQ {
         }
     }
 
+    // A full insertion buffer is flushed unless the value goes into a deletion buffer with room left
+    template <typename Stats>
+    void push(const_reference value, Stats& stats) {
+        if (insertion_end_ == insertion_buffer_size &&
+            !(deletion_end_ > 0 && deletion_end_ < deletion_buffer_size && !pq_.compare(value, deletion_buffer_[0]))) {
+            stats.add(stats::Counter::buffer_flushes);
+        }
+        push(value);
+    }
+
+    // The raw arrays of the queue, e.g. to write a checkpoint of trivially copyable values
+    [[nodiscard]] parts_type parts() const noexcept {
+        return {{{deletion_buffer_.data(), deletion_end_},
+                 {insertion_buffer_.data(), insertion_end_},
+                 {pq_.data(), pq_.size()}}};
+    }
+
+    // Replaces the elements by `parts` taken from a queue with the same comparator. The heap array is adopted as is,
+    // without restoring the heap order. Throws std::length_error if a buffer does not fit.
+    void assign_parts(parts_type const& parts) {
+        if (parts[0].second > deletion_buffer_size || parts[1].second > insertion_buffer_size) {
+            throw std::length_error("Buffer does not fit");
+        }
+        pq_.assign_heap(parts[2].first, parts[2].first + parts[2].second);
+        deletion_end_ = parts[0].second;
+        insertion_end_ = parts[1].second;
+        std::copy_n(parts[0].first, deletion_end_, deletion_buffer_.begin());
+        std::copy_n(parts[1].first, insertion_end_, insertion_buffer_.begin());
+    }
+
+    // Moves all elements to `out` in no particular order and leaves the queue empty
+    template <typename OutputIt>
+    OutputIt extract(OutputIt out) {
+        out = std::move(deletion_buffer_.begin(), deletion_buffer_.begin() + deletion_end_, out);
+        out = std::move(insertion_buffer_.begin(), insertion_buffer_.begin() + insertion_end_, out);
+        deletion_end_ = 0;
+        insertion_end_ = 0;
+        return pq_.extract(out);
+    }
+
     void reserve(size_type new_cap) {
         pq_.reserve(new_cap);
     }
+
+    // Like `reserve`, but also writes the storage, so its pages are first touched by the calling thread
+    void reserve_touched(size_type new_cap) {
+        pq_.reserve_touched(new_cap);
+    }
+
+    // The capacity of the priority queue, the buffers are part of this object
+    [[nodiscard]] size_type capacity() const noexcept {
+        return pq_.capacity();
+    }
+
+    void shrink_to_fit() {
+        pq_.shrink_to_fit();
+    }
+
+    value_compare value_comp() const {
+        return pq_.value_comp();
+    }
+
+    auto get_allocator() const noexcept {
+        return pq_.get_allocator();
+    }
 };
 
 template <typename PriorityQueue>
@@ -157,11 +299,40 @@ class BufferedPQ<PriorityQueue, 0, 0> : public PriorityQueue {
     using priority_queue_type = PriorityQueue;
 
    public:
+    using parts_type = std::array<
+        std::pair<typename priority_queue_type::value_type const*, typename priority_queue_type::size_type>, 3>;
+
     using priority_queue_type::priority_queue_type;
 
+    [[nodiscard]] parts_type parts() const noexcept {
+        return {{{nullptr, 0}, {nullptr, 0}, {priority_queue_type::data(), priority_queue_type::size()}}};
+    }
+
+    void assign_parts(parts_type const& parts) {
+        if (parts[0].second != 0 || parts[1].second != 0) {
+            throw std::length_error("Buffer does not fit");
+        }
+        priority_queue_type::assign_heap(parts[2].first, parts[2].first + parts[2].second);
+    }
+
     void reserve(typename priority_queue_type::size_type new_cap) {
         priority_queue_type::c.reserve(new_cap);
     }
+
+    void reserve_touched(typename priority_queue_type::size_type new_cap) {
+        auto const size = priority_queue_type::c.size();
+        priority_queue_type::c.reserve(new_cap);
+        priority_queue_type::c.resize(std::max(size, new_cap));
+        priority_queue_type::c.resize(size);
+    }
+
+    [[nodiscard]] typename priority_queue_type::size_type capacity() const noexcept {
+        return priority_queue_type::c.capacity();
+    }
+
+    void shrink_to_fit() {
+        priority_queue_type::c.shrink_to_fit();
+    }
 };
 
 }  // namespace multiqueue
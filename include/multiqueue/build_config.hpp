@@ -22,4 +22,9 @@ static constexpr std::size_t page_size = PAGE_SIZE;
 #else
 static constexpr std::size_t page_size = 4096;
 #endif
+#ifdef DISABLE_PREFETCH
+static constexpr bool prefetch = false;
+#else
+static constexpr bool prefetch = true;
+#endif
 }  // namespace multiqueue::build_config
@@ -0,0 +1,264 @@
+#pragma once
+
+#include "multiqueue/build_config.hpp"
+#include "multiqueue/multiqueue.hpp"
+#include "multiqueue/parallel.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Checkpoints of multiqueues with trivially copyable values or pairs of them, e.g. to survive restarts of a service. A checkpoint file
+// holds a header, one entry per queue and the raw arrays of every queue: the deletion buffer, the insertion buffer and
+// the heap array. The arrays of every queue start on a page of their own, so threads write and read the queues in
+// parallel through a shared mapping of the file. Restoring copies the arrays back as they are, so no heap is rebuilt.
+
+namespace multiqueue {
+
+namespace detail {
+
+// Values are stored as raw bytes. std::pair is not trivially copyable since its assignment operators are user-provided,
+// but a pair of trivially copyable members is copied and destroyed trivially, so key/value multiqueues qualify.
+template <typename T>
+struct is_checkpointable : std::is_trivially_copyable<T> {};
+
+template <typename First, typename Second>
+struct is_checkpointable<std::pair<First, Second>>
+    : std::conjunction<is_checkpointable<First>, is_checkpointable<Second>> {};
+
+// A file mapped into memory, unmapped on destruction
+class MappedFile {
+    std::byte *data_{nullptr};
+    std::size_t size_{0};
+
+    MappedFile(void *data, std::size_t size) noexcept : data_{static_cast<std::byte *>(data)}, size_{size} {
+    }
+
+    [[noreturn]] static void fail(int error, char const *what) {
+        throw std::system_error(error, std::generic_category(), what);
+    }
+
+   public:
+    // Creates or truncates the file at `path` to `size` bytes and maps it writable
+    static MappedFile create(std::string const &path, std::size_t size) {
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1) {
+            fail(errno, "Cannot create checkpoint file");
+        }
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            auto const error = errno;
+            ::close(fd);
+            fail(error, "Cannot resize checkpoint file");
+        }
+        void *data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        auto const error = errno;
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            fail(error, "Cannot map checkpoint file");
+        }
+        return MappedFile(data, size);
+    }
+
+    // Maps the file at `path` read-only
+    static MappedFile open(std::string const &path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            fail(errno, "Cannot open checkpoint file");
+        }
+        struct stat info {};
+        if (::fstat(fd, &info) != 0) {
+            auto const error = errno;
+            ::close(fd);
+            fail(error, "Cannot read checkpoint file");
+        }
+        auto const size = static_cast<std::size_t>(info.st_size);
+        if (size == 0) {
+            ::close(fd);
+            throw std::invalid_argument("Not a checkpoint file");
+        }
+        void *data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        auto const error = errno;
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            fail(error, "Cannot map checkpoint file");
+        }
+        return MappedFile(data, size);
+    }
+
+    MappedFile(MappedFile &&other) noexcept
+        : data_{std::exchange(other.data_, nullptr)}, size_{std::exchange(other.size_, 0)} {
+    }
+
+    MappedFile(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile &&) = delete;
+
+    ~MappedFile() {
+        if (data_ != nullptr) {
+            ::munmap(data_, size_);
+        }
+    }
+
+    // Writes the mapped pages back to the file
+    void sync() const {
+        if (::msync(data_, size_, MS_SYNC) != 0) {
+            fail(errno, "Cannot write checkpoint file");
+        }
+    }
+
+    [[nodiscard]] std::byte *data() const noexcept {
+        return data_;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        return size_;
+    }
+};
+
+struct CheckpointHeader {
+    // "MQCKPT01" in little endian
+    static constexpr std::uint64_t magic_value = 0x3130'5450'4b43'514d;
+
+    std::uint64_t magic;
+    std::uint64_t value_size;
+    std::uint64_t num_pqs;
+};
+
+// The arrays of a queue are stored one after another at `offset`, in the order of `parts()`
+struct CheckpointEntry {
+    std::uint64_t offset;
+    std::uint64_t sizes[3];
+};
+
+struct CheckpointAccess {
+    static std::size_t align(std::size_t offset) noexcept {
+        return (offset + build_config::page_size - 1) / build_config::page_size * build_config::page_size;
+    }
+
+    template <typename MultiQueue>
+    static void save(MultiQueue &mq, std::string const &path, unsigned num_threads) {
+        using value_type = typename MultiQueue::value_type;
+        auto &context = mq.context_;
+        std::optional<MappedFile> file;
+        context.with_all_guards([&](std::size_t num_pqs) {
+            std::vector<CheckpointEntry> entries(num_pqs);
+            auto offset = align(sizeof(CheckpointHeader) + num_pqs * sizeof(CheckpointEntry));
+            for (std::size_t i = 0; i < num_pqs; ++i) {
+                auto const parts = context.pq_guards()[i].get_pq().parts();
+                entries[i].offset = offset;
+                for (std::size_t p = 0; p < parts.size(); ++p) {
+                    entries[i].sizes[p] = parts[p].second;
+                    offset += parts[p].second * sizeof(value_type);
+                }
+                offset = align(offset);
+            }
+            file.emplace(MappedFile::create(path, offset));
+            CheckpointHeader const header{CheckpointHeader::magic_value, sizeof(value_type), num_pqs};
+            std::memcpy(file->data(), &header, sizeof(header));
+            std::memcpy(file->data() + sizeof(header), entries.data(), num_pqs * sizeof(CheckpointEntry));
+            parallel::for_each_thread(num_threads, [&](unsigned t) {
+                for (std::size_t i = t; i < num_pqs; i += num_threads) {
+                    auto *dest = file->data() + entries[i].offset;
+                    for (auto const &part : context.pq_guards()[i].get_pq().parts()) {
+                        if (part.second != 0) {
+                            std::memcpy(dest, part.first, part.second * sizeof(value_type));
+                        }
+                        dest += part.second * sizeof(value_type);
+                    }
+                }
+            });
+        });
+        // The queues are already unlocked again
+        file->sync();
+    }
+
+    template <typename MultiQueue>
+    static void restore(MultiQueue &mq, std::string const &path, unsigned num_threads) {
+        using value_type = typename MultiQueue::value_type;
+        using parts_type = typename MultiQueue::priority_queue_type::parts_type;
+        auto const file = MappedFile::open(path);
+        CheckpointHeader header{};
+        if (file.size() < sizeof(header)) {
+            throw std::invalid_argument("Not a checkpoint file");
+        }
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (header.magic != CheckpointHeader::magic_value || header.value_size != sizeof(value_type) ||
+            header.num_pqs > (file.size() - sizeof(header)) / sizeof(CheckpointEntry)) {
+            throw std::invalid_argument("Not a checkpoint file of this value type");
+        }
+        std::vector<CheckpointEntry> entries(header.num_pqs);
+        std::memcpy(entries.data(), file.data() + sizeof(header), entries.size() * sizeof(CheckpointEntry));
+        for (auto const &entry : entries) {
+            auto end = entry.offset;
+            bool valid = entry.offset % alignof(value_type) == 0 && end <= file.size();
+            for (auto size : entry.sizes) {
+                valid = valid && size <= (file.size() - end) / sizeof(value_type);
+                end += valid ? size * sizeof(value_type) : 0;
+            }
+            if (!valid) {
+                throw std::invalid_argument("Corrupted checkpoint file");
+            }
+        }
+        auto &context = mq.context_;
+        context.with_all_guards([&](std::size_t num_pqs) {
+            if (entries.size() > num_pqs) {
+                throw std::invalid_argument("The checkpoint has more queues than are in use");
+            }
+            parallel::for_each_thread(num_threads, [&](unsigned t) {
+                for (std::size_t i = t; i < num_pqs; i += num_threads) {
+                    parts_type parts{};
+                    if (i < entries.size()) {
+                        auto const *src = reinterpret_cast<value_type const *>(file.data() + entries[i].offset);
+                        for (std::size_t p = 0; p < parts.size(); ++p) {
+                            parts[p] = {src, entries[i].sizes[p]};
+                            src += entries[i].sizes[p];
+                        }
+                    }
+                    context.pq_guards()[i].get_pq().assign_parts(parts);
+                }
+            });
+        });
+    }
+};
+
+}  // namespace detail
+
+// Writes the elements of `mq` to a checkpoint file at `path`, using `num_threads` threads. All queues are locked while
+// they are copied into the mapped file, the multiqueue itself is left unchanged. Throws std::system_error if the file
+// cannot be written.
+template <typename MultiQueue>
+void save_checkpoint(MultiQueue &mq, std::string const &path,
+                     unsigned num_threads = std::thread::hardware_concurrency()) {
+    static_assert(detail::is_checkpointable<typename MultiQueue::value_type>::value,
+                  "Checkpoints require trivially copyable values or pairs of them");
+    detail::CheckpointAccess::save(mq, path, std::max(num_threads, 1U));
+}
+
+// Replaces the elements of `mq` by those of the checkpoint at `path`, using `num_threads` threads. The checkpoint must
+// stem from a multiqueue with the same value type, comparator and priority queue, and with at most `mq.num_pqs()`
+// queues in use. Throws std::invalid_argument if the file is no such checkpoint and std::system_error if it cannot be
+// read.
+template <typename MultiQueue>
+void restore_checkpoint(MultiQueue &mq, std::string const &path,
+                        unsigned num_threads = std::thread::hardware_concurrency()) {
+    static_assert(detail::is_checkpointable<typename MultiQueue::value_type>::value,
+                  "Checkpoints require trivially copyable values or pairs of them");
+    detail::CheckpointAccess::restore(mq, path, std::max(num_threads, 1U));
+}
+
+}  // namespace multiqueue
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "multiqueue/build_config.hpp"
+#include "multiqueue/utils.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+// Slots where handles whose pop found no element wait for a pushed element, selected by `Policy::elimination_slots`.
+// A handle pushing an element that beats the top keys of its pop candidates offers it to a waiting handle first (see
+// Handle::push), so the pair of operations never touches a queue. A waiter gives up after a short spin, and a value is
+// only handed to a waiter that has not given up yet.
+
+namespace multiqueue {
+
+template <typename Value, std::size_t Size>
+class EliminationArray {
+    static_assert(Size > 0, "The elimination array needs at least one slot");
+
+    enum State : std::uint8_t { free_slot, waiting_slot, busy_slot, full_slot };
+
+    struct alignas(build_config::l1_cache_line_size) Slot {
+        std::atomic<State> state{free_slot};
+        Value value{};
+    };
+
+    std::array<Slot, Size> slots_{};
+
+   public:
+    // Pauses a waiter spins before giving up
+    static constexpr unsigned wait_spins = 256;
+
+    // Hands `value` to a handle waiting in any slot, starting at slot `hint`. Returns false if no handle waits.
+    bool offer(Value const &value, std::size_t hint) {
+        for (std::size_t i = 0; i < Size; ++i) {
+            auto &slot = slots_[(hint + i) % Size];
+            auto expected = waiting_slot;
+            if (slot.state.load(std::memory_order_relaxed) == waiting_slot &&
+                slot.state.compare_exchange_strong(expected, busy_slot, std::memory_order_acquire,
+                                                   std::memory_order_relaxed)) {
+                slot.value = value;
+                slot.state.store(full_slot, std::memory_order_release);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Waits in slot `hint` for an offered value. Returns std::nullopt if the slot is taken or no value is offered in
+    // time.
+    std::optional<Value> wait(std::size_t hint) {
+        auto &slot = slots_[hint % Size];
+        auto expected = free_slot;
+        if (slot.state.load(std::memory_order_relaxed) != free_slot ||
+            !slot.state.compare_exchange_strong(expected, waiting_slot, std::memory_order_relaxed,
+                                               std::memory_order_relaxed)) {
+            return std::nullopt;
+        }
+        for (unsigned i = 0; i < wait_spins && slot.state.load(std::memory_order_relaxed) == waiting_slot; ++i) {
+            utils::pause();
+        }
+        expected = waiting_slot;
+        if (slot.state.compare_exchange_strong(expected, free_slot, std::memory_order_relaxed,
+                                               std::memory_order_relaxed)) {
+            return std::nullopt;
+        }
+        // An offer took the slot and is writing the value
+        while (slot.state.load(std::memory_order_acquire) != full_slot) {
+            utils::pause();
+        }
+        std::optional<Value> value{std::move(slot.value)};
+        slot.state.store(free_slot, std::memory_order_release);
+        return value;
+    }
+};
+
+// Stands in for the elimination array if `Policy::elimination_slots` is zero
+struct NoEliminationArray {
+    template <typename Value>
+    static constexpr bool offer(Value const & /*value*/, std::size_t /*hint*/) noexcept {
+        return false;
+    }
+};
+
+}  // namespace multiqueue
@@ -1,59 +1,333 @@
 #pragma once
 
+#include "multiqueue/stats.hpp"
+
+#include <cstddef>
+#include <limits>
 #include <optional>
+#include <utility>
 
 namespace multiqueue {
 
 template <typename Context>
 class Handle : public Context::policy_type::mode_type {
     using mode_type = typename Context::policy_type::mode_type;
+    using stats_type = typename Context::policy_type::stats_type;
+    static constexpr bool eliminate_pushes = Context::policy_type::eliminate_pushes;
 
+    // A moved-from handle has no context and does not own its id
     Context *context_;
+    std::size_t id_;
+    [[no_unique_address]] stats_type stats_{};
+    using key_type = typename Context::key_type;
     using value_type = typename Context::value_type;
+    // A pushed element kept for the next pop, see `eliminate()`
+    std::optional<value_type> kept_{};
+
+    template <typename Ticket>
+    Handle(Context &ctx, Ticket ticket) noexcept
+        : mode_type{ctx.config(), ctx.shared_data(), ticket.id, ticket.generation}, context_{&ctx}, id_{ticket.id} {
+    }
+
+    // What a pop takes from the queue it locked. The modes check `accepts(key)` on the top key of their best candidate
+    // before locking it and call `take(guard, stats)` on the locked, nonempty queue, which returns whether it popped.
+    struct TakeTop {
+        static constexpr bool bounded = false;
+        std::optional<value_type> value;
+
+        static constexpr bool accepts(key_type const & /*key*/) noexcept {
+            return true;
+        }
+
+        template <typename Guard, typename Stats>
+        bool operator()(Guard &guard, Stats &stats) {
+            value = guard.get_pq().top();
+            guard.pop(stats);
+            return true;
+        }
+    };
+
+    // Takes the top element if its key is not worse than `bound`
+    struct TakeIf {
+        static constexpr bool bounded = true;
+        Context const *context;
+        key_type bound;
+        std::optional<value_type> value;
+
+        [[nodiscard]] bool accepts(key_type const &key) const noexcept {
+            return !context->compare(key, bound);
+        }
+
+        template <typename Guard, typename Stats>
+        bool operator()(Guard &guard, Stats &stats) {
+            if (!accepts(Context::get_key(guard.get_pq().top()))) {
+                return false;
+            }
+            value = guard.get_pq().top();
+            guard.pop(stats);
+            return true;
+        }
+    };
+
+    // Takes up to `max_count` elements in bulk as long as their keys are not worse than `bound`
+    template <typename OutputIt>
+    struct TakeUntil {
+        static constexpr bool bounded = true;
+        Context const *context;
+        key_type bound;
+        OutputIt out;
+        std::size_t max_count;
+        std::size_t count = 0;
+
+        [[nodiscard]] bool accepts(key_type const &key) const noexcept {
+            return !context->compare(key, bound);
+        }
+
+        template <typename Guard, typename Stats>
+        bool operator()(Guard &guard, Stats &stats) {
+            count = guard.pop_while([this](value_type const &v) { return accepts(Context::get_key(v)); }, max_count,
+                                    out, stats);
+            return count != 0;
+        }
+    };
+
+    // Lets `take` pop from the locked guard, returns false if it did not pop
+    template <typename Guard, typename Take>
+    bool take_from(Guard &guard, Take &take) {
+        if (guard.get_pq().empty() || !take(guard, stats_)) {
+            guard.unlock();
+            return false;
+        }
+        guard.popped();
+        guard.unlock();
+        return true;
+    }
+
+    // Tries to pop from the queue with the best key in the top key shadow
+    template <typename Take>
+    bool scan_shadow(Take &take) {
+        auto const [index, key] = context_->top_key_shadow().best(0, context_->num_pqs(), context_->comp());
+        if (Context::is_sentinel(key) || !take.accepts(key)) {
+            return false;
+        }
+        auto &guard = context_->pq_guards()[index];
+        return guard.try_lock(stats_) && take_from(guard, take);
+    }
+
+    // Tries every queue in use, skipping those whose top key `take` does not accept without locking them
+    template <typename Take>
+    bool scan(Take &take) {
+        if constexpr (Context::policy_type::shadow_top_keys) {
+            // The shadow may be stale, so an unsuccessful attempt falls back to trying every queue
+            if (scan_shadow(take)) {
+                return true;
+            }
+        }
+        for (auto *it = context_->pq_guards(); it != context_->pq_guards() + context_->num_pqs(); ++it) {
+            if constexpr (Take::bounded) {
+                if (!take.accepts(it->top_key())) {
+                    continue;
+                }
+            }
+            if (it->try_lock(stats_) && take_from(*it, take)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Tries the mode `pop_tries` times, then scans if `Policy::scan` is set
+    template <typename Take>
+    bool pop_with(Take &take) {
+        for (int i = 0; i < Context::policy_type::pop_tries; ++i) {
+            if (mode_type::try_take(*context_, take, stats_)) {
+                return true;
+            }
+        }
+        if (!Context::policy_type::scan) {
+            return false;
+        }
+        stats_.add(stats::Counter::scan_fallbacks);
+        return scan(take);
+    }
+
+    std::optional<value_type> take_kept() {
+        std::optional<value_type> v = std::move(kept_);
+        kept_.reset();
+        context_->remove_kept();
+        return v;
+    }
+
+    // Keeps `v` instead of pushing it if it beats the top keys of the pop candidates, since the next pop of this or any
+    // other handle would likely take it right away. A handle waiting in the elimination array gets it right away,
+    // otherwise it replaces a worse kept element, which is then pushed. If all candidates are empty, the element is
+    // pushed, so that other handles can pop it.
+    bool eliminate(value_type const &v) {
+        auto const key = Context::get_key(v);
+        auto const best_key = mode_type::peek_key(*context_);
+        if (!context_->compare(best_key, key)) {
+            return false;
+        }
+        if (context_->elimination().offer(v, id_)) {
+            stats_.add(stats::Counter::eliminated_pushes);
+            return true;
+        }
+        if (Context::is_sentinel(best_key)) {
+            return false;
+        }
+        if (kept_) {
+            if (!context_->compare(Context::get_key(*kept_), key)) {
+                return false;
+            }
+            mode_type::push(*context_, *kept_, stats_);
+        } else {
+            context_->add_kept();
+        }
+        kept_ = v;
+        stats_.add(stats::Counter::kept_pushes);
+        return true;
+    }
+
+    // A kept element is pushed when the handle is released, so no element is lost
+    void release() {
+        if constexpr (eliminate_pushes) {
+            if (kept_) {
+                mode_type::push(*context_, *kept_, stats_);
+                kept_.reset();
+                context_->remove_kept();
+            }
+        }
+        context_->release_handle(id_, stats_);
+    }
 
    public:
-    explicit Handle(Context &ctx) noexcept : mode_type{ctx.config(), ctx.shared_data()}, context_{&ctx} {
+    explicit Handle(Context &ctx) : Handle(ctx, ctx.acquire_handle()) {
     }
 
     Handle(Handle const &) = delete;
-    Handle(Handle &&) noexcept = default;
+
+    Handle(Handle &&other) noexcept
+        : mode_type{std::move(other)},
+          context_{std::exchange(other.context_, nullptr)},
+          id_{other.id_},
+          stats_{other.stats_},
+          kept_{std::move(other.kept_)} {
+        other.kept_.reset();
+    }
+
     Handle &operator=(Handle const &) = delete;
-    Handle &operator=(Handle &&) noexcept = default;
-    ~Handle() = default;
+
+    Handle &operator=(Handle &&other) noexcept {
+        if (this != &other) {
+            if (context_ != nullptr) {
+                release();
+            }
+            mode_type::operator=(std::move(other));
+            context_ = std::exchange(other.context_, nullptr);
+            id_ = other.id_;
+            stats_ = other.stats_;
+            kept_ = std::move(other.kept_);
+            other.kept_.reset();
+        }
+        return *this;
+    }
+
+    ~Handle() {
+        if (context_ != nullptr) {
+            release();
+        }
+    }
+
+    [[nodiscard]] std::size_t id() const noexcept {
+        return id_;
+    }
+
+    // The events counted by this handle so far, they are added to the multiqueue's totals when it is destroyed
+    [[nodiscard]] stats_type const &stats() const noexcept {
+        return stats_;
+    }
+
+    // The best top key among the queues the next pop would choose from, or the sentinel if they are all empty. The
+    // candidates are selected like for a pop, but no queue is locked. A kept element counts as a candidate.
+    [[nodiscard]] key_type peek_key() {
+        auto key = mode_type::peek_key(*context_);
+        if constexpr (eliminate_pushes) {
+            if (kept_ && context_->compare(key, Context::get_key(*kept_))) {
+                key = Context::get_key(*kept_);
+            }
+        }
+        return key;
+    }
 
     void push(value_type const &v) {
-        mode_type::push(*context_, v);
+        if constexpr (eliminate_pushes) {
+            if (eliminate(v)) {
+                return;
+            }
+        }
+        mode_type::push(*context_, v, stats_);
     }
 
     std::optional<value_type> scan() {
-        for (auto *it = context_->pq_guards(); it != context_->pq_guards() + context_->num_pqs(); ++it) {
-            if (!it->try_lock()) {
-                continue;
+        TakeTop take;
+        scan(take);
+        return std::move(take.value);
+    }
+
+    // With `Policy::eliminate_pushes`, a kept element is returned first, and a handle that finds no element waits for
+    // one in the elimination array
+    std::optional<value_type> try_pop() {
+        if constexpr (eliminate_pushes) {
+            if (kept_) {
+                return take_kept();
             }
-            if (it->get_pq().empty()) {
-                it->unlock();
-                continue;
+        }
+        TakeTop take;
+        pop_with(take);
+        if constexpr (Context::policy_type::elimination_slots > 0) {
+            if (!take.value) {
+                return context_->elimination().wait(id_);
             }
-            auto v = it->get_pq().top();
-            it->get_pq().pop();
-            it->popped();
-            it->unlock();
-            return v;
         }
-        return std::nullopt;
+        return std::move(take.value);
     }
 
-    std::optional<value_type> try_pop() {
-        for (int i = 0; i < Context::policy_type::pop_tries; ++i) {
-            std::optional<value_type> v = mode_type::try_pop(*context_);
-            if (v) {
-                return v;
+    // Pops an element whose key is not worse than `bound`, e.g. from the current bucket of delta-stepping. The top keys
+    // of the candidates are compared with `bound` before locking, so a pop that finds no such element mostly locks
+    // nothing.
+    std::optional<value_type> try_pop_if(key_type const &bound) {
+        if constexpr (eliminate_pushes) {
+            if (kept_ && !context_->compare(Context::get_key(*kept_), bound)) {
+                return take_kept();
             }
         }
-        if (!Context::policy_type::scan) {
-            return std::nullopt;
+        TakeIf take{context_, bound, std::nullopt};
+        pop_with(take);
+        return std::move(take.value);
+    }
+
+    // Pops up to `max_count` elements whose keys are not worse than `bound` from one queue into `out`, best first, and
+    // returns their number. Like `try_pop_if`, candidates are checked before locking. With BufferedPQ, the elements
+    // are moved out of its sorted deletion buffer in runs. A kept element within the bound comes first.
+    template <typename OutputIt>
+    std::size_t try_pop_bulk_until(key_type const &bound, OutputIt out,
+                                   std::size_t max_count = std::numeric_limits<std::size_t>::max()) {
+        std::size_t count = 0;
+        if constexpr (eliminate_pushes) {
+            if (max_count != 0 && kept_ && !context_->compare(Context::get_key(*kept_), bound)) {
+                *out = std::move(*kept_);
+                ++out;
+                kept_.reset();
+                context_->remove_kept();
+                count = 1;
+            }
+        }
+        if (count == max_count) {
+            return count;
         }
-        return scan();
+        TakeUntil<OutputIt> take{context_, bound, out, max_count - count};
+        pop_with(take);
+        return count + take.count;
     }
 };
 
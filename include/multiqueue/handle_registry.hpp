@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace multiqueue {
+
+// Hands out ids to handles and takes them back when a handle is destroyed. The smallest free id is reused first, so
+// the ids of the live handles stay dense and per-id state of the modes is picked up by the next handle. Handles are
+// created and destroyed rarely, so a spin lock is sufficient. The free ids are stored with the allocator of the
+// multiqueue, so the registry can live in shared memory. Every acquisition also gets a generation, the number of
+// acquisitions before it, so handles reusing an id can seed their random streams differently.
+template <typename Allocator = std::allocator<std::size_t>>
+class HandleRegistry {
+   public:
+    using id_type = std::size_t;
+
+    struct Ticket {
+        id_type id;
+        std::size_t generation;
+    };
+
+   private:
+    struct SpinLock {
+        std::atomic_flag flag = ATOMIC_FLAG_INIT;
+
+        void lock() noexcept {
+            while (flag.test_and_set(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+
+        void unlock() noexcept {
+            flag.clear(std::memory_order_release);
+        }
+    };
+
+    SpinLock lock_;
+    std::vector<id_type, Allocator> free_ids_;
+    id_type next_id_{0};
+    std::size_t generation_{0};
+    id_type max_num_handles_;
+    std::atomic<std::size_t> num_handles_{0};
+
+   public:
+    explicit HandleRegistry(id_type max_num_handles, Allocator const &alloc = Allocator())
+        : free_ids_(alloc), max_num_handles_{max_num_handles} {
+    }
+
+    Ticket acquire() {
+        std::lock_guard guard{lock_};
+        id_type id{};
+        if (!free_ids_.empty()) {
+            std::pop_heap(free_ids_.begin(), free_ids_.end(), std::greater<>{});
+            id = free_ids_.back();
+            free_ids_.pop_back();
+        } else if (next_id_ < max_num_handles_) {
+            // Reserve room to take back every id handed out, so releasing never allocates
+            free_ids_.reserve(next_id_ + 1);
+            id = next_id_++;
+        } else {
+            throw std::length_error("Maximum number of handles exceeded");
+        }
+        num_handles_.fetch_add(1, std::memory_order_relaxed);
+        return {id, generation_++};
+    }
+
+    void release(id_type id) noexcept {
+        std::lock_guard guard{lock_};
+        free_ids_.push_back(id);
+        std::push_heap(free_ids_.begin(), free_ids_.end(), std::greater<>{});
+        num_handles_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] std::size_t num_handles() const noexcept {
+        return num_handles_.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] id_type max_num_handles() const noexcept {
+        return max_num_handles_;
+    }
+};
+
+}  // namespace multiqueue
@@ -9,6 +9,7 @@
 **/
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <functional>
@@ -124,6 +125,11 @@ class Heap {
     explicit Heap(Alloc const &alloc) noexcept : c(alloc), comp() {
     }
 
+    // Copies the elements and comparator of `other` into storage from `alloc`
+    template <typename Alloc, typename = std::enable_if_t<std::uses_allocator_v<Container, Alloc>>>
+    Heap(Heap const &other, Alloc const &alloc) : c(other.c, alloc), comp{other.comp} {
+    }
+
     [[nodiscard]] constexpr bool empty() const noexcept {
         return c.empty();
     }
@@ -162,9 +168,33 @@ class Heap {
         c.clear();
     }
 
+    // The heap array, e.g. to write a checkpoint
+    [[nodiscard]] value_type const *data() const noexcept {
+        return c.data();
+    }
+
+    // Replaces the elements by [first, last), which must already be in heap order, e.g. a copy of `data()`. The heap
+    // order is not restored.
+    template <typename ForwardIt>
+    void assign_heap(ForwardIt first, ForwardIt last) {
+        c.assign(first, last);
+    }
+
+    // Moves all elements to `out` in heap order and leaves the heap empty
+    template <typename OutputIt>
+    OutputIt extract(OutputIt out) {
+        out = std::move(c.begin(), c.end(), out);
+        c.clear();
+        return out;
+    }
+
     constexpr value_compare value_comp() const {
         return comp;
     }
+
+    auto get_allocator() const noexcept {
+        return c.get_allocator();
+    }
 };
 
 }  // namespace multiqueue
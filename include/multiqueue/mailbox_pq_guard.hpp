@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace multiqueue {
+
+// Wraps a guard with a bounded mailbox for pushes that failed to lock it, selected by `Policy::push_mailbox_size`. Any
+// thread posts into a free slot without locking, and the lock holder delivers all posted values into its queue before
+// unlocking. A value posted after the last delivery is not stranded: the holder checks the mailbox again after
+// unlocking and relocks to deliver, while the poster tries to lock after posting. Sequentially consistent fences
+// between the pending count and the lock word make sure one of them succeeds.
+template <typename Guard, typename Value, std::size_t Capacity>
+class MailboxPQGuard : public Guard {
+    static_assert(Capacity > 0, "The mailbox needs at least one slot");
+
+    enum State : std::uint8_t { empty_slot, busy_slot, full_slot };
+
+    struct Slot {
+        std::atomic<State> state{empty_slot};
+        Value value{};
+    };
+
+    std::atomic_size_t pending_{0};
+    std::array<Slot, Capacity> slots_{};
+
+    // Exactly one thread takes a posted value: the lock holder, or a poster taking values back from a closed guard
+    bool take(Slot &slot, Value &value) {
+        auto expected = full_slot;
+        if (slot.state.load(std::memory_order_relaxed) != full_slot ||
+            !slot.state.compare_exchange_strong(expected, busy_slot, std::memory_order_acquire,
+                                                std::memory_order_relaxed)) {
+            return false;
+        }
+        value = std::move(slot.value);
+        slot.state.store(empty_slot, std::memory_order_release);
+        pending_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    template <typename Unlock, typename Relock>
+    void deliver_and_unlock(Unlock unlock, Relock relock) {
+        do {
+            deliver();
+            unlock();
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        } while (has_mail() && relock());
+    }
+
+   public:
+    static constexpr std::size_t capacity = Capacity;
+
+    using Guard::Guard;
+
+    // Posts `value` without locking, returns false if all slots are taken
+    bool post(Value const &value) {
+        for (auto &slot : slots_) {
+            auto expected = empty_slot;
+            if (slot.state.load(std::memory_order_relaxed) == empty_slot &&
+                slot.state.compare_exchange_strong(expected, busy_slot, std::memory_order_acquire,
+                                                   std::memory_order_relaxed)) {
+                slot.value = value;
+                pending_.fetch_add(1, std::memory_order_relaxed);
+                slot.state.store(full_slot, std::memory_order_release);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    [[nodiscard]] bool has_mail() const noexcept {
+        return pending_.load(std::memory_order_relaxed) != 0;
+    }
+
+    // Calls `f` with every posted value, taking it out of the mailbox
+    template <typename F>
+    void take_all(F &&f) {
+        for (auto &slot : slots_) {
+            Value value;
+            if (take(slot, value)) {
+                f(std::move(value));
+            }
+        }
+    }
+
+    // Moves all posted values into the queue, the lock must be held. Every value is reported as pushed, like a push of
+    // the lock holder, so wrapped guards such as ProfilingPQGuard count it.
+    void deliver() {
+        if (!has_mail()) {
+            return;
+        }
+        take_all([this](Value &&value) {
+            Guard::get_pq().push(std::move(value));
+            Guard::pushed();
+        });
+    }
+
+    // Posted values count as soon as they are posted
+    [[nodiscard]] std::size_t size() const noexcept {
+        return Guard::size() + pending_.load(std::memory_order_relaxed);
+    }
+
+    void unlock() {
+        deliver_and_unlock([this] { Guard::unlock(); }, [this] { return Guard::try_lock(); });
+    }
+
+    void unlock(std::uint32_t mark) {
+        deliver_and_unlock([this, mark] { Guard::unlock(mark); }, [this, mark] { return Guard::try_lock(true, mark); });
+    }
+};
+
+}  // namespace multiqueue
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "multiqueue/buffered_pq.hpp"
+#include "multiqueue/heap.hpp"
+#include "multiqueue/multiqueue.hpp"
+#include "multiqueue/sentinel.hpp"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Memory resources for the storage of the queues, used through the `pmr` multiqueue aliases below. A multiqueue
+// propagates its allocator into every queue it constructs. The range constructor instead keeps the allocator of each
+// given queue, so every queue can have an arena of its own, e.g. a `std::pmr::unsynchronized_pool_resource`. Such an
+// arena needs no synchronization, since a queue is only modified under its lock.
+
+namespace multiqueue {
+
+// Serves allocations of at least `threshold` bytes from anonymous mappings aligned to and advised for transparent huge
+// pages, which reduces TLB misses on large heaps. Smaller allocations, and all allocations where huge pages are not
+// supported, are forwarded to `upstream`.
+class HugePageResource : public std::pmr::memory_resource {
+   public:
+    static constexpr std::size_t huge_page_size = std::size_t{1} << 21;
+
+   private:
+    std::pmr::memory_resource *upstream_;
+    std::size_t threshold_;
+
+    [[nodiscard]] bool is_mapped(std::size_t bytes, std::size_t alignment) const noexcept {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        return bytes >= threshold_ && alignment <= huge_page_size;
+#else
+        (void)bytes;
+        (void)alignment;
+        return false;
+#endif
+    }
+
+    static std::size_t mapping_size(std::size_t bytes) noexcept {
+        return (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+    }
+
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+        if (!is_mapped(bytes, alignment)) {
+            return upstream_->allocate(bytes, alignment);
+        }
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        // Map one huge page more than needed and unmap the unaligned ends
+        auto const size = mapping_size(bytes);
+        void *p = mmap(nullptr, size + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        auto const begin = reinterpret_cast<std::uintptr_t>(p);
+        auto const aligned = (begin + huge_page_size - 1) / huge_page_size * huge_page_size;
+        if (aligned != begin) {
+            munmap(p, aligned - begin);
+        }
+        if (auto const tail = begin + size + huge_page_size - (aligned + size); tail != 0) {
+            munmap(reinterpret_cast<void *>(aligned + size), tail);
+        }
+        madvise(reinterpret_cast<void *>(aligned), size, MADV_HUGEPAGE);
+        return reinterpret_cast<void *>(aligned);
+#else
+        return nullptr;
+#endif
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override {
+        if (!is_mapped(bytes, alignment)) {
+            upstream_->deallocate(p, bytes, alignment);
+            return;
+        }
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        munmap(p, mapping_size(bytes));
+#endif
+    }
+
+    [[nodiscard]] bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override {
+        return this == &other;
+    }
+
+   public:
+    explicit HugePageResource(std::size_t threshold = huge_page_size,
+                              std::pmr::memory_resource *upstream = std::pmr::get_default_resource()) noexcept
+        : upstream_{upstream}, threshold_{threshold} {
+    }
+
+    [[nodiscard]] std::pmr::memory_resource *upstream_resource() const noexcept {
+        return upstream_;
+    }
+};
+
+namespace pmr {
+
+template <typename Value, typename Compare>
+using PriorityQueue = BufferedPQ<Heap<Value, Compare, 8, std::pmr::vector<Value>>>;
+
+template <typename T, typename Compare = std::less<>, typename Policy = DefaultPolicy,
+          typename Sentinel = sentinel::Implicit<T, Compare>>
+using ValueMultiQueue = multiqueue::ValueMultiQueue<T, Compare, Policy, PriorityQueue<T, Compare>, Sentinel,
+                                                    std::pmr::polymorphic_allocator<PriorityQueue<T, Compare>>>;
+
+template <typename Key, typename T, typename Compare = std::less<>, typename Policy = DefaultPolicy,
+          typename Sentinel = sentinel::Implicit<Key, Compare>>
+using KeyValueMultiQueue = multiqueue::KeyValueMultiQueue<
+    Key, T, Compare, Policy,
+    PriorityQueue<std::pair<Key, T>, utils::ValueCompare<std::pair<Key, T>, utils::PairFirst, Compare>>, Sentinel,
+    std::pmr::polymorphic_allocator<
+        PriorityQueue<std::pair<Key, T>, utils::ValueCompare<std::pair<Key, T>, utils::PairFirst, Compare>>>>;
+
+}  // namespace pmr
+
+}  // namespace multiqueue
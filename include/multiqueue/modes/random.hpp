@@ -1,13 +1,14 @@
 #pragma once
 
+#include "multiqueue/stats.hpp"
+
 #include "pcg_random.hpp"
 
 #include <algorithm>
 #include <array>
-#include <atomic>
 #include <cassert>
 #include <cstddef>
-#include <optional>
+#include <limits>
 #include <random>
 
 namespace multiqueue::mode {
@@ -17,15 +18,20 @@ class Random {
     static_assert(num_pop_candidates > 0);
 
    public:
+    // The number of queues a pop compares, at least this many queues must be in use
+    static constexpr std::size_t pop_candidates = static_cast<std::size_t>(num_pop_candidates);
+
     struct Config {
         int seed{1};
     };
 
     struct SharedData {
-        std::atomic_int id_count{0};
-
         explicit SharedData(std::size_t /*num_pqs*/) noexcept {
         }
+
+        [[nodiscard]] static constexpr std::size_t max_num_handles() noexcept {
+            return std::numeric_limits<std::size_t>::max();
+        }
     };
 
    private:
@@ -33,6 +39,7 @@ class Random {
 
     std::array<std::size_t, static_cast<std::size_t>(num_pop_candidates)> generate_indices(
         std::size_t num_pqs) noexcept {
+        assert(num_pqs >= static_cast<std::size_t>(num_pop_candidates));
         std::array<std::size_t, static_cast<std::size_t>(num_pop_candidates)> indices{};
         indices[0] = std::uniform_int_distribution<std::size_t>{0, num_pqs - 1}(rng_);
         for (auto it = std::next(indices.begin()); it != indices.end(); ++it) {
@@ -44,54 +51,92 @@ class Random {
     }
 
    protected:
-    explicit Random(Config const& config, SharedData& shared_data) noexcept {
-        auto id = shared_data.id_count.fetch_add(1, std::memory_order_relaxed);
-        auto seq = std::seed_seq{config.seed, id};
+    explicit Random(Config const& config, SharedData& /*shared_data*/, std::size_t id,
+                    std::size_t generation) noexcept {
+        auto seq = std::seed_seq{config.seed, static_cast<int>(id), static_cast<int>(generation)};
         rng_.seed(seq);
     }
 
+    // The best top key of freshly sampled pop candidates, read without locking
     template <typename Context>
-    std::optional<typename Context::value_type> try_pop(Context& ctx) {
+    typename Context::key_type peek_key(Context const& ctx) {
+        auto const indices = generate_indices(ctx.num_pqs());
+        auto best_key = ctx.top_key(indices[0]);
+        for (std::size_t i = 1; i < static_cast<std::size_t>(num_pop_candidates); ++i) {
+            auto key = ctx.top_key(indices[i]);
+            if (ctx.compare(best_key, key)) {
+                best_key = key;
+            }
+        }
+        return best_key;
+    }
+
+    // Locks the best of the sampled candidates and lets `take` pop from it if `take` accepts its top key, see Handle
+    template <typename Context, typename Take, typename Stats>
+    bool try_take(Context& ctx, Take& take, Stats& stats) {
+        typename Context::backoff_type backoff{};
         while (true) {
             auto indices = generate_indices(ctx.num_pqs());
+            for (auto i : indices) {
+                ctx.prefetch_top_key(i);
+            }
             auto best_pq = indices[0];
-            auto best_key = ctx.pq_guards()[best_pq].top_key();
+            auto best_key = ctx.top_key(best_pq);
             for (std::size_t i = 1; i < static_cast<std::size_t>(num_pop_candidates); ++i) {
-                auto key = ctx.pq_guards()[indices[i]].top_key();
+                auto key = ctx.top_key(indices[i]);
                 if (ctx.compare(best_key, key)) {
                     best_pq = indices[i];
                     best_key = key;
                 }
             }
+            if (!take.accepts(best_key)) {
+                return false;
+            }
             auto& guard = ctx.pq_guards()[best_pq];
-            if (!guard.try_lock()) {
+            if (!guard.try_lock(stats)) {
+                backoff.wait(guard);
                 continue;
             }
+            guard.prefetch_pq();
             if (guard.get_pq().empty()) {
                 guard.unlock();
-                return std::nullopt;
+                stats.add(stats::Counter::empty_candidates);
+                return false;
             }
-            if (!pop_stale && Context::get_key(guard.get_pq().top()) != best_key) {
-                guard.unlock();
-                continue;
+            if ((!pop_stale || Stats::enabled) && Context::get_key(guard.get_pq().top()) != best_key) {
+                stats.add(stats::Counter::stale_pops);
+                if (!pop_stale) {
+                    guard.unlock();
+                    continue;
+                }
+            }
+            bool const taken = take(guard, stats);
+            if (taken) {
+                guard.popped();
             }
-            auto v = guard.get_pq().top();
-            guard.get_pq().pop();
-            guard.popped();
             guard.unlock();
-            return v;
+            return taken;
         }
     }
 
-    template <typename Context>
-    void push(Context& ctx, typename Context::value_type const& v) {
-        std::size_t i{};
-        do {
-            i = std::uniform_int_distribution<std::size_t>{0, ctx.num_pqs() - 1}(rng_);
-        } while (!ctx.pq_guards()[i].try_lock());
-        ctx.pq_guards()[i].get_pq().push(v);
-        ctx.pq_guards()[i].pushed();
-        ctx.pq_guards()[i].unlock();
+    template <typename Context, typename Stats>
+    void push(Context& ctx, typename Context::value_type const& v, Stats& stats) {
+        typename Context::backoff_type backoff{};
+        while (true) {
+            auto const index = std::uniform_int_distribution<std::size_t>{0, ctx.num_pqs() - 1}(rng_);
+            auto& guard = ctx.pq_guards()[index];
+            if (guard.try_lock(stats)) {
+                guard.prefetch_pq();
+                guard.push(v, stats);
+                guard.pushed();
+                guard.unlock();
+                return;
+            }
+            if (ctx.post(index, v, stats)) {
+                return;
+            }
+            backoff.wait(guard);
+        }
     }
 };
 
@@ -1,12 +1,15 @@
 #pragma once
 
+#include "multiqueue/stats.hpp"
+
 #include "pcg_random.hpp"
 
 #include <algorithm>
 #include <array>
-#include <atomic>
+#include <cassert>
 #include <cstddef>
-#include <optional>
+#include <cstdint>
+#include <limits>
 #include <random>
 
 namespace multiqueue::mode {
@@ -16,16 +19,22 @@ class StickMark {
     static_assert(num_pop_candidates > 0);
 
    public:
+    // The number of queues a pop compares, at least this many queues must be in use
+    static constexpr std::size_t pop_candidates = static_cast<std::size_t>(num_pop_candidates);
+
     struct Config {
         int seed{1};
         int stickiness{16};
     };
 
     struct SharedData {
-        std::atomic_uint id_count{0};
-
         explicit SharedData(std::size_t /*num_pqs*/) noexcept {
         }
+
+        // The lock word stores the id incremented by one above the lock bit
+        [[nodiscard]] static constexpr std::size_t max_num_handles() noexcept {
+            return std::numeric_limits<std::uint32_t>::max() >> 1;
+        }
     };
 
    private:
@@ -35,6 +44,7 @@ class StickMark {
     int count_{};
 
     void refresh_pop_index(std::size_t num_pqs) noexcept {
+        assert(num_pqs >= static_cast<std::size_t>(num_pop_candidates));
         for (auto it = pop_index_.begin(); it != pop_index_.end(); ++it) {
             do {
                 *it = std::uniform_int_distribution<std::size_t>{0, num_pqs - 1}(rng_);
@@ -42,64 +52,119 @@ class StickMark {
         }
     }
 
+    template <typename Context>
+    void prefetch_pop_index(Context const& ctx) const noexcept {
+        for (auto i : pop_index_) {
+            ctx.prefetch_top_key(i);
+        }
+    }
+
    protected:
-    explicit StickMark(Config const& config, SharedData& shared_data) noexcept
-        : id_(shared_data.id_count.fetch_add(1, std::memory_order_relaxed)) {
-        auto seq = std::seed_seq{config.seed, static_cast<int>(id_)};
+    explicit StickMark(Config const& config, SharedData& /*shared_data*/, std::size_t id,
+                       std::size_t generation) noexcept
+        : id_(static_cast<std::uint32_t>(id)) {
+        auto seq = std::seed_seq{config.seed, static_cast<int>(id_), static_cast<int>(generation)};
         rng_.seed(seq);
     }
 
+    // The best top key of the queues the next pop compares, read without locking
     template <typename Context>
-    std::optional<typename Context::value_type> try_pop(Context& ctx) {
+    typename Context::key_type peek_key(Context const& ctx) {
+        if (count_ == 0) {
+            refresh_pop_index(ctx.num_pqs());
+            count_ = ctx.config().stickiness;
+        }
+        auto best_key = ctx.top_key(pop_index_[0]);
+        for (std::size_t i = 1; i < static_cast<std::size_t>(num_pop_candidates); ++i) {
+            auto key = ctx.top_key(pop_index_[i]);
+            if (ctx.compare(best_key, key)) {
+                best_key = key;
+            }
+        }
+        return best_key;
+    }
+
+    template <typename Context, typename Take, typename Stats>
+    bool try_take(Context& ctx, Take& take, Stats& stats) {
+        typename Context::backoff_type backoff{};
         if (count_ == 0) {
             refresh_pop_index(ctx.num_pqs());
             count_ = ctx.config().stickiness;
         }
         while (true) {
+            prefetch_pop_index(ctx);
             std::size_t best = pop_index_[0];
-            auto best_key = ctx.pq_guards()[best].top_key();
+            auto best_key = ctx.top_key(best);
             for (std::size_t i = 1; i < static_cast<std::size_t>(num_pop_candidates); ++i) {
-                auto key = ctx.pq_guards()[pop_index_[i]].top_key();
+                auto key = ctx.top_key(pop_index_[i]);
                 if (ctx.compare(best_key, key)) {
                     best = pop_index_[i];
                     best_key = key;
                 }
             }
+            if (!take.accepts(best_key)) {
+                return false;
+            }
             auto& guard = ctx.pq_guards()[best];
-            if (guard.try_lock(count_ == ctx.config().stickiness, id_)) {
+            if (guard.try_lock(count_ == ctx.config().stickiness, id_, stats)) {
+                guard.prefetch_pq();
                 if (guard.get_pq().empty()) {
                     guard.unlock(id_);
                     count_ = 0;
-                    return std::nullopt;
+                    stats.add(stats::Counter::empty_candidates);
+                    stats.add(stats::Counter::stickiness_resets);
+                    return false;
+                }
+                if constexpr (Stats::enabled) {
+                    if (Context::get_key(guard.get_pq().top()) != best_key) {
+                        stats.add(stats::Counter::stale_pops);
+                    }
+                }
+                if (!take(guard, stats)) {
+                    guard.unlock(id_);
+                    return false;
                 }
-                auto v = guard.get_pq().top();
-                guard.get_pq().pop();
                 guard.popped();
                 guard.unlock(id_);
-                --count_;
-                return v;
+                if (--count_ != 0) {
+                    prefetch_pop_index(ctx);
+                }
+                return true;
             }
+            stats.add(stats::Counter::stickiness_resets);
+            backoff.wait(guard);
             refresh_pop_index(ctx.num_pqs());
             count_ = ctx.config().stickiness;
         }
     }
 
-    template <typename Context>
-    void push(Context& ctx, typename Context::value_type const& v) {
+    template <typename Context, typename Stats>
+    void push(Context& ctx, typename Context::value_type const& v, Stats& stats) {
+        typename Context::backoff_type backoff{};
         if (count_ == 0) {
             refresh_pop_index(ctx.num_pqs());
             count_ = ctx.config().stickiness;
         }
         std::size_t push_index = rng_() % num_pop_candidates;
         while (true) {
-            auto& guard = ctx.pq_guards()[pop_index_[push_index]];
-            if (guard.try_lock(count_ == ctx.config().stickiness, id_)) {
-                guard.get_pq().push(v);
+            auto const index = pop_index_[push_index];
+            auto& guard = ctx.pq_guards()[index];
+            if (guard.try_lock(count_ == ctx.config().stickiness, id_, stats)) {
+                guard.prefetch_pq();
+                guard.push(v, stats);
                 guard.pushed();
                 guard.unlock(id_);
-                --count_;
+                if (--count_ != 0) {
+                    prefetch_pop_index(ctx);
+                }
+                return;
+            }
+            // A posted value keeps the handle on its queues
+            if (ctx.post(index, v, stats)) {
                 return;
             }
+            stats.add(stats::Counter::stickiness_resets);
+            backoff.wait(guard);
             refresh_pop_index(ctx.num_pqs());
             count_ = ctx.config().stickiness;
         }
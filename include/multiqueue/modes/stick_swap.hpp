@@ -1,6 +1,7 @@
 #pragma once
 
 #include "multiqueue/build_config.hpp"
+#include "multiqueue/stats.hpp"
 
 #include "pcg_random.hpp"
 
@@ -9,8 +10,10 @@
 #include <atomic>
 #include <cassert>
 #include <cstddef>
-#include <optional>
+#include <limits>
 #include <random>
+#include <utility>
+#include <vector>
 
 namespace multiqueue::mode {
 
@@ -19,6 +22,9 @@ class StickSwap {
     static_assert(num_pop_candidates > 0);
 
    public:
+    // The number of queues a pop compares, at least this many queues must be in use
+    static constexpr std::size_t pop_candidates = static_cast<std::size_t>(num_pop_candidates);
+
     struct alignas(build_config::l1_cache_line_size) AlignedIndex {
         std::atomic<std::size_t> value;
     };
@@ -32,13 +38,18 @@ class StickSwap {
 
     struct SharedData {
         permutation_type permutation;
-        std::atomic_int id_count{0};
 
         explicit SharedData(std::size_t num_pqs) : permutation(num_pqs) {
             for (std::size_t i = 0; i < num_pqs; ++i) {
                 permutation[i].value = i;
             }
         }
+
+        // Every handle owns `num_pop_candidates` consecutive entries of the permutation. They keep their targets
+        // when the handle is destroyed and are taken over by the next handle with the same id.
+        [[nodiscard]] std::size_t max_num_handles() const noexcept {
+            return permutation.size() / static_cast<std::size_t>(num_pop_candidates);
+        }
     };
 
    private:
@@ -46,78 +57,121 @@ class StickSwap {
     int stick_count_{};
     std::size_t offset_{};
 
-    void swap_assignment(permutation_type& perm, std::size_t index) noexcept {
+    // The permutation covers all guards up to the maximum number. A swap takes any target that is not being swapped
+    // and is repeated until the target is in use, since waiting for a target in use could wait forever for handles that
+    // hold the remaining ones while swapping themselves.
+    void swap_assignment(permutation_type& perm, std::size_t index, std::size_t num_pqs) noexcept {
         static constexpr std::size_t swapping = std::numeric_limits<std::size_t>::max();
         assert(index < num_pop_candidates);
-        std::size_t old_target = perm[offset_ + index].value.exchange(swapping, std::memory_order_relaxed);
-        std::size_t perm_index{};
         std::size_t new_target{};
         do {
-            perm_index = std::uniform_int_distribution<std::size_t>{0, perm.size() - 1}(rng_);
-            new_target = perm[perm_index].value.load(std::memory_order_relaxed);
-        } while (new_target == swapping ||
-                 !perm[perm_index].value.compare_exchange_weak(new_target, old_target, std::memory_order_relaxed));
-        perm[offset_ + index].value.store(new_target, std::memory_order_relaxed);
+            std::size_t old_target = perm[offset_ + index].value.exchange(swapping, std::memory_order_relaxed);
+            std::size_t perm_index{};
+            do {
+                perm_index = std::uniform_int_distribution<std::size_t>{0, perm.size() - 1}(rng_);
+                new_target = perm[perm_index].value.load(std::memory_order_relaxed);
+            } while (new_target == swapping ||
+                     !perm[perm_index].value.compare_exchange_weak(new_target, old_target, std::memory_order_relaxed));
+            perm[offset_ + index].value.store(new_target, std::memory_order_relaxed);
+        } while (new_target >= num_pqs);
+    }
+
+    template <typename Context>
+    void prefetch_assignment(Context const& ctx) const noexcept {
+        for (std::size_t i = 0; i < static_cast<std::size_t>(num_pop_candidates); ++i) {
+            std::size_t target = ctx.shared_data().permutation[offset_ + i].value.load(std::memory_order_relaxed);
+            ctx.prefetch_top_key(target);
+        }
     }
 
     template <typename Context>
-    std::size_t best_pop_index(Context const& ctx) noexcept {
+    std::pair<std::size_t, typename Context::key_type> best_pop_index(Context const& ctx) noexcept {
+        prefetch_assignment(ctx);
         std::size_t best = ctx.shared_data().permutation[offset_].value.load(std::memory_order_relaxed);
-        auto best_key = ctx.pq_guards()[best].top_key();
+        auto best_key = ctx.top_key(best);
         for (std::size_t i = 1; i < static_cast<std::size_t>(num_pop_candidates); ++i) {
             std::size_t target = ctx.shared_data().permutation[offset_ + i].value.load(std::memory_order_relaxed);
-            auto key = ctx.pq_guards()[target].top_key();
+            auto key = ctx.top_key(target);
             if (ctx.compare(best_key, key)) {
                 best = target;
                 best_key = key;
             }
         }
-        return best;
+        return {best, best_key};
     }
 
    protected:
-    explicit StickSwap(Config const& config, SharedData& shared_data) noexcept {
-        auto id = shared_data.id_count.fetch_add(1, std::memory_order_relaxed);
-        auto seq = std::seed_seq{config.seed, id};
+    explicit StickSwap(Config const& config, SharedData& shared_data, std::size_t id,
+                       std::size_t generation) noexcept {
+        assert(id < shared_data.max_num_handles());
+        (void)shared_data;
+        auto seq = std::seed_seq{config.seed, static_cast<int>(id), static_cast<int>(generation)};
         rng_.seed(seq);
-        offset_ = static_cast<std::size_t>(id * num_pop_candidates);
+        offset_ = id * static_cast<std::size_t>(num_pop_candidates);
     }
 
+    // The best top key of the assigned queues, read without locking. An expired assignment is not swapped, its queues
+    // are still valid candidates.
     template <typename Context>
-    std::optional<typename Context::value_type> try_pop(Context& ctx) {
+    typename Context::key_type peek_key(Context const& ctx) noexcept {
+        return best_pop_index(ctx).second;
+    }
+
+    template <typename Context, typename Take, typename Stats>
+    bool try_take(Context& ctx, Take& take, Stats& stats) {
+        typename Context::backoff_type backoff{};
         if (stick_count_ == 0) {
             for (std::size_t i = 0; i < static_cast<std::size_t>(num_pop_candidates); ++i) {
-                swap_assignment(ctx.shared_data().permutation, i);
+                swap_assignment(ctx.shared_data().permutation, i, ctx.num_pqs());
             }
             stick_count_ = ctx.config().stickiness;
         }
         while (true) {
-            auto& guard = ctx.pq_guards()[best_pop_index(ctx)];
-            if (guard.try_lock()) {
+            auto [best, best_key] = best_pop_index(ctx);
+            if (!take.accepts(best_key)) {
+                return false;
+            }
+            auto& guard = ctx.pq_guards()[best];
+            if (guard.try_lock(stats)) {
+                guard.prefetch_pq();
                 if (guard.get_pq().empty()) {
                     guard.unlock();
                     stick_count_ = 0;
-                    return std::nullopt;
+                    stats.add(stats::Counter::empty_candidates);
+                    stats.add(stats::Counter::stickiness_resets);
+                    return false;
+                }
+                if constexpr (Stats::enabled) {
+                    if (Context::get_key(guard.get_pq().top()) != best_key) {
+                        stats.add(stats::Counter::stale_pops);
+                    }
+                }
+                if (!take(guard, stats)) {
+                    guard.unlock();
+                    return false;
                 }
-                auto v = guard.get_pq().top();
-                guard.get_pq().pop();
                 guard.popped();
                 guard.unlock();
-                --stick_count_;
-                return v;
+                if (--stick_count_ != 0) {
+                    prefetch_assignment(ctx);
+                }
+                return true;
             }
+            stats.add(stats::Counter::stickiness_resets);
+            backoff.wait(guard);
             for (std::size_t i = 0; i < static_cast<std::size_t>(num_pop_candidates); ++i) {
-                swap_assignment(ctx.shared_data().permutation, i);
+                swap_assignment(ctx.shared_data().permutation, i, ctx.num_pqs());
             }
             stick_count_ = ctx.config().stickiness;
         }
     }
 
-    template <typename Context>
-    void push(Context& ctx, typename Context::value_type const& v) {
+    template <typename Context, typename Stats>
+    void push(Context& ctx, typename Context::value_type const& v, Stats& stats) {
+        typename Context::backoff_type backoff{};
         if (stick_count_ == 0) {
             for (std::size_t i = 0; i < static_cast<std::size_t>(num_pop_candidates); ++i) {
-                swap_assignment(ctx.shared_data().permutation, i);
+                swap_assignment(ctx.shared_data().permutation, i, ctx.num_pqs());
             }
             stick_count_ = ctx.config().stickiness;
         }
@@ -125,14 +179,23 @@ class StickSwap {
         while (true) {
             auto target = ctx.shared_data().permutation[offset_ + push_index].value.load(std::memory_order_relaxed);
             auto& guard = ctx.pq_guards()[target];
-            if (guard.try_lock()) {
-                guard.get_pq().push(v);
+            if (guard.try_lock(stats)) {
+                guard.prefetch_pq();
+                guard.push(v, stats);
                 guard.pushed();
                 guard.unlock();
-                --stick_count_;
+                if (--stick_count_ != 0) {
+                    prefetch_assignment(ctx);
+                }
+                return;
+            }
+            // A posted value keeps the handle on its queues
+            if (ctx.post(target, v, stats)) {
                 return;
             }
-            swap_assignment(ctx.shared_data().permutation, push_index);
+            stats.add(stats::Counter::stickiness_resets);
+            backoff.wait(guard);
+            swap_assignment(ctx.shared_data().permutation, push_index, ctx.num_pqs());
         }
     }
 };
@@ -9,32 +9,94 @@
 **/
 #pragma once
 
+#include "multiqueue/backoff.hpp"
 #include "multiqueue/buffered_pq.hpp"
+#include "multiqueue/elimination.hpp"
 #include "multiqueue/handle.hpp"
+#include "multiqueue/handle_registry.hpp"
 #include "multiqueue/heap.hpp"
+#include "multiqueue/mailbox_pq_guard.hpp"
 #include "multiqueue/modes/random.hpp"
+#include "multiqueue/parallel.hpp"
+#include "multiqueue/parking_pq_guard.hpp"
 #include "multiqueue/pq_guard.hpp"
+#include "multiqueue/profiling_pq_guard.hpp"
 #include "multiqueue/sentinel.hpp"
+#include "multiqueue/shadowing_pq_guard.hpp"
+#include "multiqueue/stats.hpp"
+#include "multiqueue/top_key_shadow.hpp"
 #include "multiqueue/utils.hpp"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
 #include <cstdlib>
+#include <iterator>
+#include <limits>
 #include <memory>
 #include <mutex>
+#include <ostream>
 #include <stdexcept>
+#include <thread>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace multiqueue {
 
+namespace detail {
+
+template <typename PriorityQueue, typename = void>
+struct has_get_allocator : std::false_type {};
+
+template <typename PriorityQueue>
+struct has_get_allocator<PriorityQueue, std::void_t<decltype(std::declval<PriorityQueue const &>().get_allocator())>>
+    : std::true_type {};
+
+// Implements the checkpoints in checkpoint.hpp
+struct CheckpointAccess;
+
+}  // namespace detail
+
+// Memory held by a multiqueue in bytes
+struct MemoryUsage {
+    // The guard array, including the buffers of the priority queues
+    std::size_t guards = 0;
+    std::size_t shadow = 0;
+    // The reserved storage of the priority queues
+    std::size_t heaps = 0;
+
+    [[nodiscard]] std::size_t total() const noexcept {
+        return guards + shadow + heaps;
+    }
+};
+
 template <typename Value, typename Compare>
 using DefaultPriorityQueue = BufferedPQ<Heap<Value, Compare>>;
 
+// Custom policies derive from this and override what they change
 struct DefaultPolicy {
     using mode_type = mode::Random<>;
     static constexpr int pop_tries = 1;
     static constexpr bool scan = true;
+    // `stats::Counters` counts events per handle, see stats.hpp
+    using stats_type = stats::None;
+    // Record lock and operation counts as well as lock hold times per queue, see profiling_pq_guard.hpp
+    static constexpr bool profile_guards = false;
+    // What to do after a failed lock attempt, see backoff.hpp
+    using backoff_type = backoff::None;
+    // Keep the top key of each queue on its own cache line, away from the lock and the queue, see pq_guard.hpp
+    static constexpr bool separate_top_key = false;
+    // Mirror the top keys into a dense array used to compare candidates and to scan, see top_key_shadow.hpp
+    static constexpr bool shadow_top_keys = false;
+    // Slots per queue for pushes that fail to lock it, delivered by the lock holder, see mailbox_pq_guard.hpp
+    static constexpr std::size_t push_mailbox_size = 0;
+    // Handles keep a pushed element that beats the top keys of their pop candidates for their next pop, see handle.hpp
+    static constexpr bool eliminate_pushes = false;
+    // Slots where handles that found no element wait for such an element, see elimination.hpp
+    static constexpr std::size_t elimination_slots = 0;
 };
 
 template <typename Key, typename Value, typename KeyOfValue, typename Compare = std::less<>,
@@ -56,42 +118,90 @@ class MultiQueue {
     using allocator_type = Allocator;
     using sentinel_type = Sentinel;
     using config_type = typename policy_type::mode_type::Config;
+    using stats_type = typename policy_type::stats_type;
+    using backoff_type = typename policy_type::backoff_type;
 
    private:
-    using guard_type = PQGuard<key_type, value_type, KeyOfValue, priority_queue_type, sentinel_type>;
+    using base_guard_type = PQGuard<key_type, value_type, KeyOfValue, priority_queue_type, sentinel_type,
+                                    policy_type::separate_top_key>;
+    using shadow_slot_pointer = typename std::allocator_traits<
+        typename std::allocator_traits<allocator_type>::template rebind_alloc<std::atomic<key_type>>>::pointer;
+    using shadowing_guard_type =
+        std::conditional_t<policy_type::shadow_top_keys,
+                           ShadowingPQGuard<base_guard_type, key_type, shadow_slot_pointer>, base_guard_type>;
+    // Below the mailbox, so that the profile records the values the lock holder delivers and its relocks
+    using profiling_guard_type = std::conditional_t<policy_type::profile_guards,
+                                                    ProfilingPQGuard<shadowing_guard_type>, shadowing_guard_type>;
+    using mailbox_guard_type =
+        std::conditional_t<(policy_type::push_mailbox_size > 0),
+                           MailboxPQGuard<profiling_guard_type, value_type, policy_type::push_mailbox_size>,
+                           profiling_guard_type>;
+    using parking_guard_type =
+        std::conditional_t<backoff_type::parks, ParkingPQGuard<mailbox_guard_type>, mailbox_guard_type>;
+    using top_key_shadow_type = std::conditional_t<policy_type::shadow_top_keys,
+                                                   TopKeyShadow<key_type, key_compare, sentinel_type, allocator_type>,
+                                                   NoTopKeyShadow>;
+    using elimination_type =
+        std::conditional_t<(policy_type::elimination_slots > 0),
+                           EliminationArray<value_type, policy_type::elimination_slots>, NoEliminationArray>;
+    using guard_type = parking_guard_type;
     using internal_allocator_type = typename std::allocator_traits<allocator_type>::template rebind_alloc<guard_type>;
+    using guard_pointer = typename std::allocator_traits<internal_allocator_type>::pointer;
+    using handle_registry_type =
+        HandleRegistry<typename std::allocator_traits<allocator_type>::template rebind_alloc<std::size_t>>;
+
+    static_assert(policy_type::eliminate_pushes || policy_type::elimination_slots == 0,
+                  "Elimination slots require eliminate_pushes");
 
     class Context {
         friend MultiQueue;
+        friend detail::CheckpointAccess;
 
        public:
         using key_type = MultiQueue::key_type;
         using value_type = MultiQueue::value_type;
         using policy_type = MultiQueue::policy_type;
         using guard_type = MultiQueue::guard_type;
+        using backoff_type = MultiQueue::backoff_type;
         using shared_data_type = typename policy_type::mode_type::SharedData;
 
        private:
-        size_type num_pqs_{};
-        guard_type *pq_guards_{nullptr};
+        // Only the first `num_pqs_` of the `max_num_pqs_` guards are in use. The others are closed, i.e. empty and
+        // permanently locked, so handles still holding indices of a closed guard fail to lock it and retry.
+        std::atomic<size_type> num_pqs_{};
+        size_type max_num_pqs_{};
+        std::atomic_flag resize_lock_ = ATOMIC_FLAG_INIT;
+        // Allocates the guards and, if the priority queue supports it, the storage of every queue
+        [[no_unique_address]] internal_allocator_type alloc_;
+        // An offset pointer if the allocator places the guards in shared memory
+        guard_pointer guard_storage_{nullptr};
+        [[no_unique_address]] top_key_shadow_type top_key_shadow_;
+        [[no_unique_address]] elimination_type elimination_;
         [[no_unique_address]] config_type config_;
         [[no_unique_address]] shared_data_type data_;
+        handle_registry_type handle_registry_;
+        // Elements kept by handles instead of pushed, see `Policy::eliminate_pushes`
+        std::atomic<size_type> num_kept_{0};
+        [[no_unique_address]] stats::Aggregate<stats_type> stats_;
         [[no_unique_address]] key_compare comp_;
-        [[no_unique_address]] internal_allocator_type alloc_;
 
         explicit Context(size_type num_pqs, config_type const &config, priority_queue_type const &pq,
                          key_compare const &comp, allocator_type const &alloc)
             : num_pqs_{num_pqs},
-              pq_guards_{std::allocator_traits<internal_allocator_type>::allocate(alloc_, num_pqs_)},
+              max_num_pqs_{num_pqs},
+              alloc_{alloc},
+              guard_storage_{std::allocator_traits<internal_allocator_type>::allocate(alloc_, max_num_pqs_)},
+              top_key_shadow_{max_num_pqs_, alloc_},
               config_{config},
-              data_{num_pqs_},
-              comp_{comp},
-              alloc_{alloc} {
-            assert(num_pqs_ > 0);
+              data_{max_num_pqs_},
+              handle_registry_{data_.max_num_handles(), alloc_},
+              comp_{comp} {
+            assert(max_num_pqs_ > 0);
 
-            for (auto *it = pq_guards_; it != pq_guards_ + num_pqs_; ++it) {
-                std::allocator_traits<internal_allocator_type>::construct(alloc_, it, pq);
+            for (auto *it = pq_guards(); it != pq_guards() + max_num_pqs_; ++it) {
+                std::allocator_traits<internal_allocator_type>::construct(alloc_, it, copy_pq(pq, alloc_));
             }
+            attach_shadow();
         }
 
         explicit Context(size_type num_pqs, typename priority_queue_type::size_type initial_capacity,
@@ -99,7 +209,7 @@ class MultiQueue {
                          allocator_type const &alloc)
             : Context(num_pqs, config, pq, comp, alloc) {
             auto cap_per_queue = 2 * (initial_capacity + num_pqs - 1) / num_pqs;
-            for (auto *it = pq_guards_; it != pq_guards_ + num_pqs_; ++it) {
+            for (auto *it = pq_guards(); it != pq_guards() + max_num_pqs_; ++it) {
                 it->get_pq().reserve(cap_per_queue);
             }
         }
@@ -107,22 +217,262 @@ class MultiQueue {
         template <typename ForwardIt>
         explicit Context(ForwardIt first, ForwardIt last, config_type const &config, key_compare const &comp,
                          allocator_type const &alloc)
-            : num_pqs_{std::distance(first, last)},
-              pq_guards_{std::allocator_traits<internal_allocator_type>::allocate(alloc_, num_pqs_)},
+            : num_pqs_{static_cast<size_type>(std::distance(first, last))},
+              max_num_pqs_{static_cast<size_type>(std::distance(first, last))},
+              alloc_(alloc),
+              guard_storage_{std::allocator_traits<internal_allocator_type>::allocate(alloc_, max_num_pqs_)},
+              top_key_shadow_{max_num_pqs_, alloc_},
               config_{config},
-              data_{num_pqs_},
-              comp_{comp},
-              alloc_(alloc) {
-            for (auto *it = pq_guards_; it != pq_guards_ + num_pqs_; ++it, ++first) {
-                std::allocator_traits<internal_allocator_type>::construct(alloc_, it, *first);
+              data_{max_num_pqs_},
+              handle_registry_{data_.max_num_handles(), alloc_},
+              comp_{comp} {
+            // Every queue keeps the allocator it was given, e.g. an arena of its own
+            for (auto *it = pq_guards(); it != pq_guards() + max_num_pqs_; ++it, ++first) {
+                if constexpr (detail::has_get_allocator<priority_queue_type>::value) {
+                    std::allocator_traits<internal_allocator_type>::construct(alloc_, it,
+                                                                              copy_pq(*first, first->get_allocator()));
+                } else {
+                    std::allocator_traits<internal_allocator_type>::construct(alloc_, it, *first);
+                }
             }
+            attach_shadow();
         }
 
         ~Context() noexcept {
-            for (auto *it = pq_guards_; it != pq_guards_ + num_pqs_; ++it) {
+            for (auto *it = pq_guards(); it != pq_guards() + max_num_pqs_; ++it) {
                 std::allocator_traits<internal_allocator_type>::destroy(alloc_, it);
             }
-            std::allocator_traits<internal_allocator_type>::deallocate(alloc_, pq_guards_, num_pqs_);
+            std::allocator_traits<internal_allocator_type>::deallocate(alloc_, guard_storage_, max_num_pqs_);
+        }
+
+        // Copies `pq` into storage from `alloc` if the priority queue supports allocators. Copy construction alone
+        // would not propagate allocators such as std::pmr::polymorphic_allocator.
+        template <typename Alloc>
+        static priority_queue_type copy_pq(priority_queue_type const &pq, Alloc const &alloc) {
+            if constexpr (std::uses_allocator_v<priority_queue_type, Alloc>) {
+                return priority_queue_type(pq, alloc);
+            } else {
+                return pq;
+            }
+        }
+
+        void attach_shadow() noexcept {
+            if constexpr (policy_type::shadow_top_keys) {
+                for (size_type i = 0; i < max_num_pqs_; ++i) {
+                    pq_guards()[i].attach_shadow(top_key_shadow_.slot(i));
+                }
+            }
+        }
+
+        // Resizing waits for guards held by handles, which might be preempted. Posted values are delivered right away,
+        // so the queue holds all elements of the guard.
+        static void lock(guard_type &guard) {
+            backoff::lock(guard, backoff::Yield{});
+            if constexpr (policy_type::push_mailbox_size > 0) {
+                guard.deliver();
+            }
+        }
+
+        // Moves all elements of a closed guard into the open ones, locking each open guard once
+        void drain(guard_type &closed, size_type num_open) {
+            std::vector<value_type> elements;
+            elements.reserve(closed.get_pq().size());
+            while (!closed.get_pq().empty()) {
+                elements.push_back(closed.get_pq().top());
+                closed.get_pq().pop();
+            }
+            auto const chunk_size = (elements.size() + num_open - 1) / num_open;
+            auto it = elements.begin();
+            for (size_type i = 0; it != elements.end(); ++i) {
+                auto &guard = pq_guards()[i];
+                lock(guard);
+                auto const chunk_end = it + static_cast<std::ptrdiff_t>(
+                                                std::min(chunk_size, static_cast<size_type>(elements.end() - it)));
+                for (; it != chunk_end; ++it) {
+                    guard.get_pq().push(std::move(*it));
+                }
+                guard.pushed();
+                guard.unlock();
+            }
+            // Only now the closed guard reports its size as zero, so size() and empty() do not miss moving elements
+            closed.get_pq().shrink_to_fit();
+            closed.popped();
+        }
+
+        void resize(size_type num_pqs) {
+            if (num_pqs < std::max(size_type{1}, policy_type::mode_type::pop_candidates) || num_pqs > max_num_pqs_) {
+                throw std::invalid_argument(
+                    "Number of priority queues must be in [number of pop candidates, max_num_pqs()]");
+            }
+            while (resize_lock_.test_and_set(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            auto const old_num_pqs = num_pqs_.load(std::memory_order_relaxed);
+            if (num_pqs > old_num_pqs) {
+                for (auto *it = pq_guards() + old_num_pqs; it != pq_guards() + num_pqs; ++it) {
+                    it->unlock();
+                }
+                num_pqs_.store(num_pqs, std::memory_order_release);
+            } else if (num_pqs < old_num_pqs) {
+                // Handles that already chose a guard beyond the new size are waited for by locking it. Values posted
+                // to it after the fence see it closed and are taken back by their posters.
+                num_pqs_.store(num_pqs, std::memory_order_release);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                for (auto *it = pq_guards() + num_pqs; it != pq_guards() + old_num_pqs; ++it) {
+                    lock(*it);
+                    drain(*it, num_pqs);
+                }
+            }
+            resize_lock_.clear(std::memory_order_release);
+        }
+
+        // Locks guard `index`, calls `f` with it and unlocks it. Returns false without calling `f` if the guard is or
+        // gets closed by a concurrent resize, since closed guards stay locked.
+        template <typename F>
+        bool with_open_guard(size_type index, F &&f) {
+            auto &guard = pq_guards()[index];
+            while (!guard.try_lock()) {
+                if (index >= num_pqs()) {
+                    return false;
+                }
+                std::this_thread::yield();
+            }
+            f(guard);
+            guard.unlock();
+            return true;
+        }
+
+        void reserve(size_type capacity, size_type part, size_type num_parts) {
+            if (num_parts == 0 || part >= num_parts) {
+                throw std::invalid_argument("Part must be in [0, num_parts)");
+            }
+            auto const num_pqs = this->num_pqs();
+            auto const cap_per_queue = 2 * (capacity + num_pqs - 1) / num_pqs;
+            for (auto i = part * num_pqs / num_parts; i < (part + 1) * num_pqs / num_parts; ++i) {
+                with_open_guard(i,
+                                [cap_per_queue](guard_type &guard) { guard.get_pq().reserve_touched(cap_per_queue); });
+            }
+        }
+
+        // Closed guards are included, they report zero once they are drained
+        [[nodiscard]] size_type size() const noexcept {
+            size_type size = num_kept_.load(std::memory_order_relaxed);
+            for (size_type i = 0; i < max_num_pqs_; ++i) {
+                size += pq_guards()[i].size();
+            }
+            return size;
+        }
+
+        [[nodiscard]] bool empty() const noexcept {
+            if (num_kept_.load(std::memory_order_relaxed) != 0) {
+                return false;
+            }
+            for (size_type i = 0; i < max_num_pqs_; ++i) {
+                if (pq_guards()[i].size() != 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        MemoryUsage memory_usage() {
+            MemoryUsage usage;
+            usage.guards = max_num_pqs_ * sizeof(guard_type);
+            usage.shadow = top_key_shadow_.memory_usage();
+            // Closed guards are shrunk when they are drained
+            for (size_type i = 0, n = num_pqs(); i < n; ++i) {
+                with_open_guard(i, [&usage](guard_type &guard) {
+                    usage.heaps += guard.get_pq().capacity() * sizeof(value_type);
+                });
+            }
+            return usage;
+        }
+
+        void trim(double min_fill) {
+            for (size_type i = 0, n = num_pqs(); i < n; ++i) {
+                with_open_guard(i, [min_fill](guard_type &guard) {
+                    auto &pq = guard.get_pq();
+                    if (static_cast<double>(pq.size()) < min_fill * static_cast<double>(pq.capacity())) {
+                        pq.shrink_to_fit();
+                    }
+                });
+            }
+        }
+
+        // Calls `f(num_pqs)` with the resize lock and all open guards held, so neither a resize nor a handle interferes.
+        // Afterwards, the guards publish the state of their queues.
+        template <typename F>
+        void with_all_guards(F &&f) {
+            while (resize_lock_.test_and_set(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            auto const num_pqs = num_pqs_.load(std::memory_order_relaxed);
+            for (size_type i = 0; i < num_pqs; ++i) {
+                lock(pq_guards()[i]);
+            }
+            auto release = [this, num_pqs] {
+                for (size_type i = 0; i < num_pqs; ++i) {
+                    pq_guards()[i].popped();
+                    pq_guards()[i].unlock();
+                }
+                resize_lock_.clear(std::memory_order_release);
+            };
+            try {
+                f(num_pqs);
+            } catch (...) {
+                release();
+                throw;
+            }
+            release();
+        }
+
+        // Closed guards are empty, they are drained when they are closed
+        template <typename OutputIt>
+        OutputIt drain(OutputIt out, unsigned num_threads) {
+            num_threads = std::max(num_threads, 1U);
+            with_all_guards([&](size_type num_pqs) {
+                if constexpr (parallel::is_random_access_v<OutputIt>) {
+                    // Every queue is moved to its own range of the output, so the threads only stream memory
+                    using difference_type = typename std::iterator_traits<OutputIt>::difference_type;
+                    std::vector<size_type> offsets(num_pqs + 1, 0);
+                    for (size_type i = 0; i < num_pqs; ++i) {
+                        offsets[i + 1] = offsets[i] + pq_guards()[i].get_pq().size();
+                    }
+                    parallel::for_each_thread(num_threads, [&](unsigned t) {
+                        for (size_type i = t; i < num_pqs; i += num_threads) {
+                            pq_guards()[i].get_pq().extract(out + static_cast<difference_type>(offsets[i]));
+                        }
+                    });
+                    out += static_cast<difference_type>(offsets[num_pqs]);
+                } else {
+                    for (size_type i = 0; i < num_pqs; ++i) {
+                        out = pq_guards()[i].get_pq().extract(out);
+                    }
+                }
+            });
+            return out;
+        }
+
+        template <typename OutputIt>
+        OutputIt drain_sorted(OutputIt out, unsigned num_threads) {
+            num_threads = std::max(num_threads, 1U);
+            auto before = [comp = comp_](value_type const &lhs, value_type const &rhs) {
+                return comp(get_key(rhs), get_key(lhs));
+            };
+            // The queues are unlocked again before the runs are merged
+            std::vector<std::vector<value_type>> runs;
+            with_all_guards([&](size_type num_pqs) {
+                runs.resize(num_pqs);
+                parallel::for_each_thread(num_threads, [&](unsigned t) {
+                    for (size_type i = t; i < num_pqs; i += num_threads) {
+                        auto &pq = pq_guards()[i].get_pq();
+                        runs[i].reserve(pq.size());
+                        pq.extract(std::back_inserter(runs[i]));
+                        std::sort(runs[i].begin(), runs[i].end(), before);
+                    }
+                });
+            });
+            return parallel::multiway_merge(runs, before, num_threads, out);
         }
 
        public:
@@ -131,12 +481,110 @@ class MultiQueue {
         Context &operator=(const Context &) = delete;
         Context &operator=(Context &&) = delete;
 
-        [[nodiscard]] constexpr size_type num_pqs() const noexcept {
-            return num_pqs_;
+        [[nodiscard]] size_type num_pqs() const noexcept {
+            return num_pqs_.load(std::memory_order_acquire);
+        }
+
+        [[nodiscard]] constexpr size_type max_num_pqs() const noexcept {
+            return max_num_pqs_;
+        }
+
+        [[nodiscard]] typename handle_registry_type::Ticket acquire_handle() {
+            return handle_registry_.acquire();
+        }
+
+        void release_handle(typename handle_registry_type::id_type id, stats_type const &stats) noexcept {
+            stats_.merge(stats);
+            handle_registry_.release(id);
+        }
+
+        void add_kept() noexcept {
+            num_kept_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Called after a kept element was popped or pushed, so it is never missed by `size()` and `empty()`
+        void remove_kept() noexcept {
+            num_kept_.fetch_sub(1, std::memory_order_relaxed);
         }
 
         [[nodiscard]] guard_type *pq_guards() const noexcept {
-            return pq_guards_;
+            return utils::to_address(guard_storage_);
+        }
+
+        // The top key of queue `index`, read from the shadow if there is one
+        [[nodiscard]] key_type top_key(size_type index) const noexcept {
+            if constexpr (policy_type::shadow_top_keys) {
+                return top_key_shadow_.load(index);
+            } else {
+                return pq_guards()[index].top_key();
+            }
+        }
+
+        // The best top key of the queues in use, read from the shadow if there is one
+        [[nodiscard]] key_type best_top_key() const noexcept {
+            auto const num_pqs = this->num_pqs();
+            if constexpr (policy_type::shadow_top_keys) {
+                return top_key_shadow_.best(0, num_pqs, comp_).second;
+            } else {
+                auto best_key = pq_guards()[0].top_key();
+                for (size_type i = 1; i < num_pqs; ++i) {
+                    auto key = pq_guards()[i].top_key();
+                    if (compare(best_key, key)) {
+                        best_key = key;
+                    }
+                }
+                return best_key;
+            }
+        }
+
+        // Posts `value` to the mailbox of guard `index` after a failed lock attempt. Returns false if the mailbox is
+        // full or disabled by `Policy::push_mailbox_size`.
+        template <typename Stats>
+        bool post(size_type index, value_type const &value, Stats &stats) {
+            if constexpr (policy_type::push_mailbox_size > 0) {
+                auto &guard = pq_guards()[index];
+                if (!guard.post(value)) {
+                    return false;
+                }
+                stats.add(stats::Counter::mailbox_posts);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (index >= num_pqs()) {
+                    // A resize may have drained the closed guard before the post, so the mail is taken back and
+                    // pushed to an open guard
+                    guard.take_all([this](value_type &&v) {
+                        auto &open = pq_guards()[0];
+                        lock(open);
+                        open.get_pq().push(std::move(v));
+                        open.pushed();
+                        open.unlock();
+                    });
+                } else if (guard.try_lock()) {
+                    // The holder unlocked before the post, unlocking delivers
+                    guard.unlock();
+                }
+                return true;
+            } else {
+                (void)index;
+                (void)value;
+                (void)stats;
+                return false;
+            }
+        }
+
+        void prefetch_top_key(size_type index) const noexcept {
+            if constexpr (policy_type::shadow_top_keys) {
+                utils::prefetch(&top_key_shadow_.slot(index));
+            } else {
+                pq_guards()[index].prefetch_top_key();
+            }
+        }
+
+        [[nodiscard]] top_key_shadow_type const &top_key_shadow() const noexcept {
+            return top_key_shadow_;
+        }
+
+        [[nodiscard]] elimination_type &elimination() noexcept {
+            return elimination_;
         }
 
         [[nodiscard]] config_type const &config() const noexcept {
@@ -174,6 +622,8 @@ class MultiQueue {
 
     Context context_;
 
+    friend detail::CheckpointAccess;
+
    public:
     using handle_type = Handle<Context>;
 
@@ -195,12 +645,115 @@ class MultiQueue {
         : context_{first, last, config, comp, internal_allocator_type(alloc)} {
     }
 
-    handle_type get_handle() noexcept {
+    // Throws std::length_error if the mode does not support more live handles. Ids of destroyed handles are reused.
+    handle_type get_handle() {
         return handle_type(context_);
     }
 
-    [[nodiscard]] constexpr size_type num_pqs() const noexcept {
-        return context_.num_pqs_;
+    [[nodiscard]] size_type num_handles() const noexcept {
+        return context_.handle_registry_.num_handles();
+    }
+
+    [[nodiscard]] size_type max_num_handles() const noexcept {
+        return context_.handle_registry_.max_num_handles();
+    }
+
+    // The summed events of all destroyed handles
+    [[nodiscard]] stats_type stats() const noexcept {
+        return context_.stats_.load();
+    }
+
+    // The profiles of the queues in use, only available if `Policy::profile_guards` is set
+    template <typename P = policy_type, typename = std::enable_if_t<P::profile_guards>>
+    [[nodiscard]] std::vector<GuardProfile> guard_profiles() const {
+        std::vector<GuardProfile> profiles;
+        profiles.reserve(num_pqs());
+        for (auto *it = context_.pq_guards(); it != context_.pq_guards() + num_pqs(); ++it) {
+            profiles.push_back(it->profile());
+        }
+        return profiles;
+    }
+
+    template <typename P = policy_type, typename = std::enable_if_t<P::profile_guards>>
+    void print_heat_table(std::ostream &out) const {
+        auto profiles = guard_profiles();
+        multiqueue::print_heat_table(out, profiles.begin(), profiles.end());
+    }
+
+    [[nodiscard]] size_type num_pqs() const noexcept {
+        return context_.num_pqs();
+    }
+
+    [[nodiscard]] constexpr size_type max_num_pqs() const noexcept {
+        return context_.max_num_pqs();
+    }
+
+    // Changes the number of priority queues in use to `num_pqs`, which must not exceed the number of queues the
+    // multiqueue was constructed with, nor be smaller than the number of pop candidates of the mode. Handles keep
+    // working while the multiqueue is resized. When shrinking, the elements of the removed queues are moved into the
+    // remaining ones.
+    void set_num_pqs(size_type num_pqs) {
+        context_.resize(num_pqs);
+    }
+
+    // Reserves storage for `capacity` elements in total, like the `initial_capacity` constructor, and writes it so that
+    // its pages are first touched by the calling thread. Called from each of `num_parts` threads with a distinct `part`,
+    // every thread reserves the storage of its share of the queues, so the reservation runs in parallel and the memory
+    // is placed near these threads. Handles can be used meanwhile.
+    void reserve(size_type capacity, size_type part = 0, size_type num_parts = 1) {
+        context_.reserve(capacity, part, num_parts);
+    }
+
+    // The number of elements, summed over the sizes the queues had after their last modification without locking
+    // them, plus the elements kept by handles (see `Policy::eliminate_pushes`). Operations in flight may or may not be
+    // included, so this is exact only while no operation runs.
+    [[nodiscard]] size_type size() const noexcept {
+        return context_.size();
+    }
+
+    // Whether all queues were empty after their last modification and no handle keeps an element (see
+    // `Policy::eliminate_pushes`). Elements whose push completed before this call, e.g. on a thread that synchronized
+    // with the caller, are always seen.
+    [[nodiscard]] bool empty() const noexcept {
+        return context_.empty();
+    }
+
+    // The best key of all elements, read from the top keys of the queues in use without locking them, or the sentinel if
+    // they are all empty. Like size(), this is exact only while no operation runs, and elements posted to a mailbox or
+    // kept by a handle are not seen.
+    [[nodiscard]] key_type approx_min_key() const noexcept {
+        return context_.best_top_key();
+    }
+
+    // The memory held by the multiqueue. The storage of every queue is read under its lock, one queue at a time.
+    [[nodiscard]] MemoryUsage memory_usage() {
+        return context_.memory_usage();
+    }
+
+    // Releases the unused storage of every queue filled to less than `min_fill` of its capacity, locking one queue at a
+    // time, so handles can be used meanwhile
+    void trim(double min_fill) {
+        context_.trim(min_fill);
+    }
+
+    // Releases the unused storage of all queues
+    void shrink_to_fit() {
+        context_.trim(std::numeric_limits<double>::infinity());
+    }
+
+    // Moves all elements to `out` in no particular order and leaves the multiqueue empty. All queues are locked
+    // meanwhile, so handles wait. With a random access `out`, e.g. the begin of a vector of size(), every queue is moved
+    // to its own range of the output by one of `num_threads` threads.
+    template <typename OutputIt>
+    OutputIt drain(OutputIt out, unsigned num_threads = std::thread::hardware_concurrency()) {
+        return context_.drain(out, num_threads);
+    }
+
+    // Moves all elements to `out`, best first, and leaves the multiqueue empty. The queues are locked while `num_threads`
+    // threads extract and sort their elements, the sorted runs are then merged in parallel.
+    template <typename OutputIt>
+    OutputIt drain_sorted(OutputIt out, unsigned num_threads = std::thread::hardware_concurrency()) {
+        return context_.drain_sorted(out, num_threads);
     }
 
     [[nodiscard]] key_compare key_comp() const {
@@ -208,7 +761,7 @@ class MultiQueue {
     }
 
     [[nodiscard]] allocator_type get_allocator() const {
-        return allocator_type_(context_.alloc_);
+        return allocator_type(context_.alloc_);
     }
 
     [[nodiscard]] config_type const &config() const {
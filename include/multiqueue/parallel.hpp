@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Helpers to run bulk operations of the multiqueue, e.g. draining it, on several threads
+
+namespace multiqueue::parallel {
+
+template <typename It>
+inline constexpr bool is_random_access_v =
+    std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<It>::iterator_category>;
+
+// Calls `f(t)` for every t in [0, num_threads), each on its own thread except t = 0, which runs on the calling thread.
+// The first exception thrown is rethrown after all threads finished.
+template <typename F>
+void for_each_thread(unsigned num_threads, F &&f) {
+    num_threads = std::max(num_threads, 1U);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto run = [&](unsigned t) {
+        try {
+            f(t);
+        } catch (...) {
+            std::lock_guard lock{error_mutex};
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads - 1);
+    for (unsigned t = 1; t < num_threads; ++t) {
+        threads.emplace_back(run, t);
+    }
+    run(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+namespace detail {
+
+// Chooses `num_parts - 1` splitters from a sample of the sorted runs and returns, for every part boundary, the position
+// of the boundary in every run. Part j consists of the ranges [bounds[j][r], bounds[j + 1][r]) of all runs r.
+template <typename T, typename Before>
+std::vector<std::vector<std::size_t>> split_runs(std::vector<std::vector<T>> const &runs, std::size_t num_parts,
+                                                 Before const &before) {
+    constexpr std::size_t oversampling = 16;
+    std::size_t total = 0;
+    for (auto const &run : runs) {
+        total += run.size();
+    }
+    std::vector<std::vector<std::size_t>> bounds(num_parts + 1, std::vector<std::size_t>(runs.size(), 0));
+    for (std::size_t r = 0; r < runs.size(); ++r) {
+        bounds[num_parts][r] = runs[r].size();
+    }
+    if (num_parts == 1 || total == 0) {
+        for (std::size_t j = 1; j < num_parts; ++j) {
+            bounds[j] = bounds[num_parts];
+        }
+        return bounds;
+    }
+    auto const step = std::max(std::size_t{1}, total / (num_parts * oversampling));
+    std::vector<T const *> samples;
+    for (auto const &run : runs) {
+        for (auto i = step / 2; i < run.size(); i += step) {
+            samples.push_back(&run[i]);
+        }
+    }
+    std::sort(samples.begin(), samples.end(), [&before](T const *lhs, T const *rhs) { return before(*lhs, *rhs); });
+    for (std::size_t j = 1; j < num_parts; ++j) {
+        if (samples.empty()) {
+            bounds[j] = bounds[num_parts];
+            continue;
+        }
+        auto const &splitter = *samples[j * samples.size() / num_parts];
+        for (std::size_t r = 0; r < runs.size(); ++r) {
+            bounds[j][r] = static_cast<std::size_t>(
+                std::lower_bound(runs[r].begin(), runs[r].end(), splitter, before) - runs[r].begin());
+        }
+    }
+    return bounds;
+}
+
+// Merges the ranges [lo[r], hi[r]) of all sorted runs into `out`
+template <typename T, typename Before, typename OutputIt>
+OutputIt merge_part(std::vector<std::vector<T>> &runs, std::vector<std::size_t> const &lo,
+                    std::vector<std::size_t> const &hi, Before const &before, OutputIt out) {
+    // A cursor is the remaining range of a run
+    using cursor_type = std::pair<T *, T *>;
+    // Heap of cursors with the cursor at the first element on top
+    auto after = [&before](cursor_type const &lhs, cursor_type const &rhs) { return before(*rhs.first, *lhs.first); };
+    std::vector<cursor_type> cursors;
+    for (std::size_t r = 0; r < runs.size(); ++r) {
+        if (lo[r] < hi[r]) {
+            cursors.emplace_back(runs[r].data() + lo[r], runs[r].data() + hi[r]);
+        }
+    }
+    std::make_heap(cursors.begin(), cursors.end(), after);
+    while (cursors.size() > 1) {
+        std::pop_heap(cursors.begin(), cursors.end(), after);
+        auto &cursor = cursors.back();
+        *out = std::move(*cursor.first);
+        ++out;
+        if (++cursor.first != cursor.second) {
+            std::push_heap(cursors.begin(), cursors.end(), after);
+        } else {
+            cursors.pop_back();
+        }
+    }
+    if (!cursors.empty()) {
+        out = std::move(cursors.front().first, cursors.front().second, out);
+    }
+    return out;
+}
+
+}  // namespace detail
+
+// Merges the runs, each sorted by `before`, into `out` on `num_threads` threads. The runs are split into one part per
+// thread at sampled splitters and every thread merges its part. With a random access `out`, the threads write their
+// parts in place, otherwise the parts are buffered and then moved to `out` in order.
+template <typename T, typename Before, typename OutputIt>
+OutputIt multiway_merge(std::vector<std::vector<T>> &runs, Before const &before, unsigned num_threads, OutputIt out) {
+    num_threads = std::max(num_threads, 1U);
+    auto const bounds = detail::split_runs(runs, num_threads, before);
+    if constexpr (is_random_access_v<OutputIt>) {
+        std::vector<std::size_t> offsets(num_threads + 1, 0);
+        for (std::size_t j = 0; j < num_threads; ++j) {
+            offsets[j + 1] = offsets[j];
+            for (std::size_t r = 0; r < runs.size(); ++r) {
+                offsets[j + 1] += bounds[j + 1][r] - bounds[j][r];
+            }
+        }
+        for_each_thread(num_threads, [&](unsigned t) {
+            detail::merge_part(runs, bounds[t], bounds[t + 1], before,
+                               out + static_cast<typename std::iterator_traits<OutputIt>::difference_type>(offsets[t]));
+        });
+        return out + static_cast<typename std::iterator_traits<OutputIt>::difference_type>(offsets[num_threads]);
+    } else {
+        std::vector<std::vector<T>> parts(num_threads);
+        for_each_thread(num_threads, [&](unsigned t) {
+            std::size_t size = 0;
+            for (std::size_t r = 0; r < runs.size(); ++r) {
+                size += bounds[t + 1][r] - bounds[t][r];
+            }
+            parts[t].reserve(size);
+            detail::merge_part(runs, bounds[t], bounds[t + 1], before, std::back_inserter(parts[t]));
+        });
+        for (auto &part : parts) {
+            out = std::move(part.begin(), part.end(), out);
+        }
+        return out;
+    }
+}
+
+}  // namespace multiqueue::parallel
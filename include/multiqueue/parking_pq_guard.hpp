@@ -0,0 +1,48 @@
+#pragma once
+
+#include "multiqueue/backoff.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace multiqueue {
+
+// Wraps a guard so that threads can sleep on its lock until it is unlocked. Parked threads register in a counter, so
+// unlocking only issues a wakeup if somebody is parked. The counter and the lock word are accessed sequentially
+// consistent to not lose wakeups in between, a parked thread times out in any case.
+template <typename Guard>
+class ParkingPQGuard : public Guard {
+    std::atomic_uint32_t parked_{0};
+
+    void wake() noexcept {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (parked_.load(std::memory_order_relaxed) != 0) {
+            backoff::futex_wake_all(Guard::lock_word());
+        }
+    }
+
+   public:
+    using Guard::Guard;
+
+    void park(std::chrono::nanoseconds timeout) noexcept {
+        parked_.fetch_add(1, std::memory_order_seq_cst);
+        auto const word = Guard::lock_word().load(std::memory_order_seq_cst);
+        if ((word & 1U) != 0U) {
+            backoff::futex_wait(Guard::lock_word(), word, timeout);
+        }
+        parked_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void unlock() {
+        Guard::unlock();
+        wake();
+    }
+
+    void unlock(std::uint32_t mark) {
+        Guard::unlock(mark);
+        wake();
+    }
+};
+
+}  // namespace multiqueue
@@ -11,38 +11,96 @@
 #pragma once
 
 #include "multiqueue/build_config.hpp"
+#include "multiqueue/stats.hpp"
+#include "multiqueue/top_key.hpp"
+#include "multiqueue/utils.hpp"
 
+#include <algorithm>
 #include <atomic>
+#include <cstddef>
 #include <type_traits>
+#include <utility>
 
 namespace multiqueue {
 
-template <typename Key, typename Value, typename KeyOfValue, typename PriorityQueue, typename Sentinel>
+namespace detail {
+
+template <typename T>
+struct alignas(build_config::l1_cache_line_size) CacheLinePadded : T {
+    using T::T;
+};
+
+// Priority queues opt into popping in bulk by providing `pop_while(pred, max_count, out)`, see BufferedPQ
+template <typename PriorityQueue, typename Predicate, typename OutputIt, typename = void>
+struct pops_while : std::false_type {};
+
+template <typename PriorityQueue, typename Predicate, typename OutputIt>
+struct pops_while<PriorityQueue, Predicate, OutputIt,
+                  std::void_t<decltype(std::declval<PriorityQueue &>().pop_while(
+                      std::declval<Predicate &>(), std::size_t{}, std::declval<OutputIt &>()))>> : std::true_type {};
+
+}  // namespace detail
+
+// With `SeparateTopKey`, the top key occupies a cache line of its own. Then locking and modifying the queue do not
+// invalidate the line that threads comparing pop candidates read, at the cost of one more line per queue.
+template <typename Key, typename Value, typename KeyOfValue, typename PriorityQueue, typename Sentinel,
+          bool SeparateTopKey = false>
 class alignas(build_config::l1_cache_line_size) PQGuard {
     using key_type = Key;
     using value_type = Value;
     using priority_queue_type = PriorityQueue;
     static_assert(std::is_same_v<value_type, typename priority_queue_type::value_type>,
                   "PriorityQueue::value_type must be the same as Value");
-    static_assert(std::atomic<key_type>::is_always_lock_free, "std::atomic<key_type> must be lock-free");
-    std::atomic<key_type> top_key_ = Sentinel::sentinel();
+    // Lock-free atomic for word-sized keys, a sequence lock otherwise
+    using top_key_storage = TopKey<key_type>;
+    std::conditional_t<SeparateTopKey, detail::CacheLinePadded<top_key_storage>, top_key_storage> top_key_{
+        Sentinel::sentinel()};
     std::atomic_uint32_t lock_ = 0;
+    // The size of the queue as of its last modification, written by the lock holder
+    std::atomic_size_t size_ = 0;
     priority_queue_type pq_;
 
+   protected:
+    std::atomic_uint32_t& lock_word() noexcept {
+        return lock_;
+    }
+
    public:
     explicit PQGuard() = default;
 
     explicit PQGuard(priority_queue_type pq) : pq_(std::move(pq)) {
+        if (!pq_.empty()) {
+            pushed();
+        }
     }
 
     [[nodiscard]] key_type top_key() const noexcept {
-        return top_key_.load(std::memory_order_relaxed);
+        return top_key_.load();
     }
 
     [[nodiscard]] bool empty() const noexcept {
         return Sentinel::is_sentinel(top_key());
     }
 
+    [[nodiscard]] std::size_t size() const noexcept {
+        return size_.load(std::memory_order_relaxed);
+    }
+
+    // Issued for all candidates before their top keys are compared, so the misses overlap
+    void prefetch_top_key() const noexcept {
+        utils::prefetch(&top_key_);
+    }
+
+    // Issued after a successful lock, the first lines of the priority queue hold its top element and buffers
+    void prefetch_pq() const noexcept {
+        constexpr std::size_t max_lines = 4;
+        auto const *first = reinterpret_cast<char const *>(&pq_);
+        auto const *last = first + std::min(sizeof(pq_), max_lines * build_config::l1_cache_line_size);
+        for (; first < last; first += build_config::l1_cache_line_size) {
+            utils::prefetch<true>(first);
+        }
+    }
+
     bool try_lock() noexcept {
         // Test first to not invalidate the cache line
         return (lock_.load(std::memory_order_relaxed) & 1U) == 0U && (lock_.exchange(1U, std::memory_order_acquire) & 1) == 0U;
@@ -64,16 +122,78 @@ class alignas(build_config::l1_cache_line_size) PQGuard {
         }
     }
 
+    template <typename Stats>
+    bool try_lock(Stats& stats) noexcept {
+        stats.add(stats::Counter::lock_attempts);
+        if (try_lock()) {
+            return true;
+        }
+        stats.add(stats::Counter::lock_failures);
+        return false;
+    }
+
+    template <typename Stats>
+    bool try_lock(bool force, uint32_t mark, Stats& stats) noexcept {
+        stats.add(stats::Counter::lock_attempts);
+        if (try_lock(force, mark)) {
+            return true;
+        }
+        stats.add(stats::Counter::lock_failures);
+        return false;
+    }
+
+    // Push to and pop from the locked priority queue, counting its events if it supports that
+    template <typename Stats>
+    void push(value_type const& value, Stats& stats) {
+        if constexpr (Stats::enabled && stats::counts_events<priority_queue_type, Stats>::value) {
+            pq_.push(value, stats);
+        } else {
+            pq_.push(value);
+        }
+    }
+
+    template <typename Stats>
+    void pop(Stats& stats) {
+        if constexpr (Stats::enabled && stats::counts_events<priority_queue_type, Stats>::value) {
+            pq_.pop(stats);
+        } else {
+            pq_.pop();
+        }
+    }
+
+    // Pops up to `max_count` elements to `out` as long as `pred` holds for the top element, in bulk if the priority queue
+    // supports it. Returns the number of popped elements.
+    template <typename Predicate, typename OutputIt, typename Stats>
+    std::size_t pop_while(Predicate pred, std::size_t max_count, OutputIt out, Stats& stats) {
+        if constexpr (detail::pops_while<priority_queue_type, Predicate, OutputIt>::value) {
+            if constexpr (Stats::enabled && stats::counts_events<priority_queue_type, Stats>::value) {
+                return pq_.pop_while(pred, max_count, out, stats);
+            } else {
+                return pq_.pop_while(pred, max_count, out);
+            }
+        } else {
+            std::size_t count = 0;
+            for (; count < max_count && !pq_.empty() && pred(pq_.top()); ++count) {
+                *out = pq_.top();
+                ++out;
+                pop(stats);
+            }
+            return count;
+        }
+    }
+
     void popped() {
         auto key = (pq_.empty() ? Sentinel::sentinel() : KeyOfValue::get(pq_.top()));
-        top_key_.store(key, std::memory_order_relaxed);
+        top_key_.store(key);
+        size_.store(pq_.size(), std::memory_order_relaxed);
     }
 
     void pushed() {
         auto key = KeyOfValue::get(pq_.top());
         if (key != top_key()) {
-            top_key_.store(key, std::memory_order_relaxed);
+            top_key_.store(key);
         }
+        size_.store(pq_.size(), std::memory_order_relaxed);
     }
 
     void unlock() {
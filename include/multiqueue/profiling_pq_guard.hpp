@@ -0,0 +1,145 @@
+#pragma once
+
+#include "multiqueue/build_config.hpp"
+#include "multiqueue/utils.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+
+namespace multiqueue {
+
+struct GuardProfile {
+    std::uint64_t lock_acquisitions = 0;
+    std::uint64_t failed_lock_attempts = 0;
+    std::uint64_t pushes = 0;
+    std::uint64_t pops = 0;
+    // Measured with utils::timestamp(), i.e. in cycles of the time stamp counter on x86
+    std::uint64_t hold_time = 0;
+};
+
+// Per-queue profile as one row per queue, with each queue's share of all operations and lock failures
+template <typename ForwardIt>
+void print_heat_table(std::ostream &out, ForwardIt first, ForwardIt last) {
+    GuardProfile total;
+    for (auto it = first; it != last; ++it) {
+        total.pushes += it->pushes;
+        total.pops += it->pops;
+        total.failed_lock_attempts += it->failed_lock_attempts;
+    }
+    auto share = [](std::uint64_t part, std::uint64_t whole) {
+        return whole == 0 ? 0.0 : 100.0 * static_cast<double>(part) / static_cast<double>(whole);
+    };
+    out << "queue,lock_acquisitions,failed_lock_attempts,pushes,pops,hold_time,hold_time_per_lock,ops_share,"
+           "failure_share\n";
+    std::size_t index = 0;
+    for (auto it = first; it != last; ++it, ++index) {
+        out << index << ',' << it->lock_acquisitions << ',' << it->failed_lock_attempts << ',' << it->pushes << ','
+            << it->pops << ',' << it->hold_time << ','
+            << (it->lock_acquisitions == 0 ? 0 : it->hold_time / it->lock_acquisitions) << ',' << std::fixed
+            << std::setprecision(2) << share(it->pushes + it->pops, total.pushes + total.pops) << ','
+            << share(it->failed_lock_attempts, total.failed_lock_attempts) << '\n';
+    }
+}
+
+// Wraps a guard and records its lock acquisitions, lock hold times and operations. Only the lock holder updates those,
+// so they are not contended. Failed lock attempts come from all threads and are spread over cache line sized shards
+// chosen per thread.
+template <typename Guard>
+class ProfilingPQGuard : public Guard {
+    static constexpr std::size_t num_shards = 8;
+
+    struct alignas(build_config::l1_cache_line_size) Shard {
+        std::atomic_uint64_t failed_lock_attempts{0};
+    };
+
+    // Written by the lock holder only, atomic so a profile can be taken concurrently
+    std::atomic_uint64_t lock_acquisitions_{0};
+    std::atomic_uint64_t pushes_{0};
+    std::atomic_uint64_t pops_{0};
+    std::atomic_uint64_t hold_time_{0};
+    std::uint64_t locked_at_{0};
+    std::array<Shard, num_shards> shards_{};
+
+    static std::size_t shard_index() noexcept {
+        static std::atomic_size_t thread_count{0};
+        thread_local std::size_t const index = thread_count.fetch_add(1, std::memory_order_relaxed) % num_shards;
+        return index;
+    }
+
+    static void increment(std::atomic_uint64_t &counter, std::uint64_t n = 1) noexcept {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    bool record_lock(bool success) noexcept {
+        if (success) {
+            increment(lock_acquisitions_);
+            locked_at_ = utils::timestamp();
+        } else {
+            shards_[shard_index()].failed_lock_attempts.fetch_add(1, std::memory_order_relaxed);
+        }
+        return success;
+    }
+
+    void record_unlock() noexcept {
+        increment(hold_time_, utils::timestamp() - locked_at_);
+    }
+
+   public:
+    using Guard::Guard;
+
+    bool try_lock() noexcept {
+        return record_lock(Guard::try_lock());
+    }
+
+    bool try_lock(bool force, std::uint32_t mark) noexcept {
+        return record_lock(Guard::try_lock(force, mark));
+    }
+
+    template <typename Stats>
+    bool try_lock(Stats &stats) noexcept {
+        return record_lock(Guard::try_lock(stats));
+    }
+
+    template <typename Stats>
+    bool try_lock(bool force, std::uint32_t mark, Stats &stats) noexcept {
+        return record_lock(Guard::try_lock(force, mark, stats));
+    }
+
+    void popped() {
+        increment(pops_);
+        Guard::popped();
+    }
+
+    void pushed() {
+        increment(pushes_);
+        Guard::pushed();
+    }
+
+    void unlock() {
+        record_unlock();
+        Guard::unlock();
+    }
+
+    void unlock(std::uint32_t mark) {
+        record_unlock();
+        Guard::unlock(mark);
+    }
+
+    [[nodiscard]] GuardProfile profile() const noexcept {
+        GuardProfile profile;
+        profile.lock_acquisitions = lock_acquisitions_.load(std::memory_order_relaxed);
+        profile.pushes = pushes_.load(std::memory_order_relaxed);
+        profile.pops = pops_.load(std::memory_order_relaxed);
+        profile.hold_time = hold_time_.load(std::memory_order_relaxed);
+        for (auto const &shard : shards_) {
+            profile.failed_lock_attempts += shard.failed_lock_attempts.load(std::memory_order_relaxed);
+        }
+        return profile;
+    }
+};
+
+}  // namespace multiqueue
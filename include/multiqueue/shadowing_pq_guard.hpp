@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+namespace multiqueue {
+
+// Wraps a guard so that it mirrors its top key into a slot of a TopKeyShadow. The slot is attached once after
+// construction, before any handle exists. `SlotPointer` is an offset pointer if the guards live in shared memory.
+template <typename Guard, typename Key, typename SlotPointer = std::atomic<Key>*>
+class ShadowingPQGuard : public Guard {
+    SlotPointer shadow_{nullptr};
+
+    void update_shadow() noexcept {
+        shadow_->store(Guard::top_key(), std::memory_order_relaxed);
+    }
+
+   public:
+    using Guard::Guard;
+
+    void attach_shadow(std::atomic<Key>& slot) noexcept {
+        shadow_ = std::pointer_traits<SlotPointer>::pointer_to(slot);
+        update_shadow();
+    }
+
+    void popped() {
+        Guard::popped();
+        update_shadow();
+    }
+
+    void pushed() {
+        Guard::pushed();
+        update_shadow();
+    }
+};
+
+}  // namespace multiqueue
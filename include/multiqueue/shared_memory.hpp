@@ -0,0 +1,537 @@
+#pragma once
+
+#include "multiqueue/build_config.hpp"
+#include "multiqueue/buffered_pq.hpp"
+#include "multiqueue/heap.hpp"
+#include "multiqueue/multiqueue.hpp"
+#include "multiqueue/sentinel.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Multiqueues shared by the processes of one host. A SharedMemorySegment maps a POSIX shared memory object, possibly at
+// a different address in every process, so objects in the segment refer to each other through OffsetPtr, which stores
+// the distance to its target instead of its address. A multiqueue constructed in the segment with the `shm` aliases
+// below allocates its guards, handle registry and heaps from the segment through ShmAllocator. Every attached process
+// can then create handles to it, which only live in their own process. Locks, sizes and top keys are lock-free
+// atomics, which work across processes. All processes must run the same build, since they share the object layout.
+
+namespace multiqueue {
+
+// A pointer to an object in the same mapping, stored as the distance from itself. The distance 1 represents null,
+// since no object starts inside the pointer itself.
+template <typename T>
+class OffsetPtr {
+    static constexpr std::ptrdiff_t null_offset = 1;
+
+    std::ptrdiff_t offset_{null_offset};
+
+    void set(T const *p) noexcept {
+        offset_ = p == nullptr
+            ? null_offset
+            : static_cast<std::ptrdiff_t>(reinterpret_cast<std::uintptr_t>(p) - reinterpret_cast<std::uintptr_t>(this));
+    }
+
+   public:
+    using element_type = T;
+    using value_type = std::remove_cv_t<T>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T *;
+    using reference = std::add_lvalue_reference_t<T>;
+    using iterator_category = std::random_access_iterator_tag;
+
+    template <typename U>
+    using rebind = OffsetPtr<U>;
+
+    OffsetPtr() noexcept = default;
+
+    OffsetPtr(std::nullptr_t) noexcept {  // NOLINT(google-explicit-constructor)
+    }
+
+    OffsetPtr(T *p) noexcept {  // NOLINT(google-explicit-constructor)
+        set(p);
+    }
+
+    OffsetPtr(OffsetPtr const &other) noexcept {
+        set(other.get());
+    }
+
+    template <typename U, typename = std::enable_if_t<std::is_convertible_v<U *, T *>>>
+    OffsetPtr(OffsetPtr<U> const &other) noexcept {  // NOLINT(google-explicit-constructor)
+        set(other.get());
+    }
+
+    OffsetPtr &operator=(OffsetPtr const &other) noexcept {
+        set(other.get());
+        return *this;
+    }
+
+    ~OffsetPtr() = default;
+
+    [[nodiscard]] T *get() const noexcept {
+        return offset_ == null_offset
+            ? nullptr
+            : reinterpret_cast<T *>(reinterpret_cast<std::uintptr_t>(this) + static_cast<std::uintptr_t>(offset_));
+    }
+
+    static OffsetPtr pointer_to(reference r) noexcept {
+        return OffsetPtr(std::addressof(r));
+    }
+
+    reference operator*() const noexcept {
+        return *get();
+    }
+
+    T *operator->() const noexcept {
+        return get();
+    }
+
+    reference operator[](difference_type n) const noexcept {
+        return get()[n];
+    }
+
+    explicit operator bool() const noexcept {
+        return offset_ != null_offset;
+    }
+
+    OffsetPtr &operator+=(difference_type n) noexcept {
+        set(get() + n);
+        return *this;
+    }
+
+    OffsetPtr &operator-=(difference_type n) noexcept {
+        set(get() - n);
+        return *this;
+    }
+
+    OffsetPtr &operator++() noexcept {
+        return *this += 1;
+    }
+
+    OffsetPtr &operator--() noexcept {
+        return *this -= 1;
+    }
+
+    OffsetPtr operator++(int) noexcept {
+        OffsetPtr old(*this);
+        ++*this;
+        return old;
+    }
+
+    OffsetPtr operator--(int) noexcept {
+        OffsetPtr old(*this);
+        --*this;
+        return old;
+    }
+
+    friend OffsetPtr operator+(OffsetPtr p, difference_type n) noexcept {
+        return p += n;
+    }
+
+    friend OffsetPtr operator+(difference_type n, OffsetPtr p) noexcept {
+        return p += n;
+    }
+
+    friend OffsetPtr operator-(OffsetPtr p, difference_type n) noexcept {
+        return p -= n;
+    }
+
+    friend difference_type operator-(OffsetPtr const &lhs, OffsetPtr const &rhs) noexcept {
+        return lhs.get() - rhs.get();
+    }
+
+    friend bool operator==(OffsetPtr const &lhs, OffsetPtr const &rhs) noexcept {
+        return lhs.get() == rhs.get();
+    }
+
+    friend bool operator!=(OffsetPtr const &lhs, OffsetPtr const &rhs) noexcept {
+        return lhs.get() != rhs.get();
+    }
+
+    friend bool operator<(OffsetPtr const &lhs, OffsetPtr const &rhs) noexcept {
+        return std::less<>{}(lhs.get(), rhs.get());
+    }
+
+    friend bool operator>(OffsetPtr const &lhs, OffsetPtr const &rhs) noexcept {
+        return rhs < lhs;
+    }
+
+    friend bool operator<=(OffsetPtr const &lhs, OffsetPtr const &rhs) noexcept {
+        return !(rhs < lhs);
+    }
+
+    friend bool operator>=(OffsetPtr const &lhs, OffsetPtr const &rhs) noexcept {
+        return !(lhs < rhs);
+    }
+
+    friend bool operator==(OffsetPtr const &p, std::nullptr_t) noexcept {
+        return !p;
+    }
+
+    friend bool operator!=(OffsetPtr const &p, std::nullptr_t) noexcept {
+        return static_cast<bool>(p);
+    }
+};
+
+// Serves the allocations of a segment from the memory following it. Blocks come in power-of-two size classes, each
+// with a free list, and are cut from the remaining memory otherwise. Blocks are aligned to their size up to a page.
+// The heaps grow by doubling, so freed blocks are reused well. A spin lock in the segment serializes all processes.
+class SharedArena {
+    static constexpr std::size_t min_block_size = build_config::l1_cache_line_size;
+    static constexpr std::size_t num_classes = 48;
+
+    struct FreeBlock {
+        OffsetPtr<FreeBlock> next;
+    };
+
+    std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+    std::size_t capacity_;
+    std::size_t top_;
+    std::array<OffsetPtr<FreeBlock>, num_classes> free_lists_{};
+
+    struct Lock {
+        std::atomic_flag &flag;
+
+        explicit Lock(std::atomic_flag &f) noexcept : flag{f} {
+            while (flag.test_and_set(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+
+        Lock(Lock const &) = delete;
+        Lock &operator=(Lock const &) = delete;
+
+        ~Lock() {
+            flag.clear(std::memory_order_release);
+        }
+    };
+
+    static std::size_t size_class(std::size_t bytes) noexcept {
+        std::size_t c = 0;
+        while (c < num_classes && (min_block_size << c) < bytes) {
+            ++c;
+        }
+        return c;
+    }
+
+    std::byte *base() noexcept {
+        return reinterpret_cast<std::byte *>(this);
+    }
+
+   public:
+    // Manages the `capacity` bytes starting at this object
+    explicit SharedArena(std::size_t capacity) noexcept : capacity_{capacity}, top_{sizeof(SharedArena)} {
+    }
+
+    SharedArena(SharedArena const &) = delete;
+    SharedArena &operator=(SharedArena const &) = delete;
+
+    void *allocate(std::size_t bytes, std::size_t alignment) {
+        auto const c = size_class(std::max(bytes, alignment));
+        if (c >= num_classes || alignment > build_config::page_size) {
+            throw std::bad_alloc();
+        }
+        auto const block_size = min_block_size << c;
+        Lock lock{lock_};
+        if (auto block = free_lists_[c]; block) {
+            free_lists_[c] = block->next;
+            return block.get();
+        }
+        auto const block_alignment = std::min(block_size, build_config::page_size);
+        auto const offset = (top_ + block_alignment - 1) / block_alignment * block_alignment;
+        if (offset > capacity_ || block_size > capacity_ - offset) {
+            throw std::bad_alloc();
+        }
+        top_ = offset + block_size;
+        return base() + offset;
+    }
+
+    void deallocate(void *p, std::size_t bytes, std::size_t alignment) noexcept {
+        auto const c = size_class(std::max(bytes, alignment));
+        Lock lock{lock_};
+        auto *block = ::new (p) FreeBlock{free_lists_[c]};
+        free_lists_[c] = block;
+    }
+
+    // The bytes cut from the segment so far, including free blocks
+    [[nodiscard]] std::size_t used() noexcept {
+        Lock lock{lock_};
+        return top_;
+    }
+
+    [[nodiscard]] std::size_t capacity() const noexcept {
+        return capacity_;
+    }
+};
+
+// Allocates from a SharedArena and hands out offset pointers, so containers in the segment work in every process. A
+// default-constructed allocator has no arena and throws std::bad_alloc on allocation.
+template <typename T>
+class ShmAllocator {
+    template <typename U>
+    friend class ShmAllocator;
+
+    OffsetPtr<SharedArena> arena_;
+
+   public:
+    using value_type = T;
+    using pointer = OffsetPtr<T>;
+    using const_pointer = OffsetPtr<T const>;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    template <typename U>
+    struct rebind {
+        using other = ShmAllocator<U>;
+    };
+
+    ShmAllocator() noexcept = default;
+
+    explicit ShmAllocator(SharedArena &arena) noexcept : arena_{&arena} {
+    }
+
+    template <typename U>
+    ShmAllocator(ShmAllocator<U> const &other) noexcept  // NOLINT(google-explicit-constructor)
+        : arena_{other.arena_} {
+    }
+
+    pointer allocate(size_type n) {
+        if (!arena_) {
+            throw std::bad_alloc();
+        }
+        return pointer(static_cast<T *>(arena_->allocate(n * sizeof(T), alignof(T))));
+    }
+
+    void deallocate(pointer p, size_type n) noexcept {
+        arena_->deallocate(p.get(), n * sizeof(T), alignof(T));
+    }
+
+    [[nodiscard]] SharedArena *arena() const noexcept {
+        return arena_.get();
+    }
+
+    template <typename U>
+    friend bool operator==(ShmAllocator const &lhs, ShmAllocator<U> const &rhs) noexcept {
+        return lhs.arena_.get() == rhs.arena_.get();
+    }
+
+    template <typename U>
+    friend bool operator!=(ShmAllocator const &lhs, ShmAllocator<U> const &rhs) noexcept {
+        return !(lhs == rhs);
+    }
+};
+
+// A POSIX shared memory object mapped into this process, unmapped on destruction. The segment holds one root object,
+// e.g. a multiqueue, which the creating process constructs and the others find.
+class SharedMemorySegment {
+    // "MQSHM001" in little endian
+    static constexpr std::uint64_t magic_value = 0x3130'304d'4853'514d;
+
+    struct Header {
+        std::uint64_t magic{magic_value};
+        std::atomic<std::uint32_t> ready{0};
+        OffsetPtr<std::byte> root;
+        alignas(build_config::l1_cache_line_size) SharedArena arena;
+
+        // The arena manages the rest of the segment
+        explicit Header(std::size_t size) noexcept
+            : arena{size - static_cast<std::size_t>(reinterpret_cast<std::byte *>(&arena) -
+                                                    reinterpret_cast<std::byte *>(this))} {
+        }
+    };
+
+    Header *header_{nullptr};
+    std::size_t size_{0};
+
+    SharedMemorySegment(void *data, std::size_t size) noexcept : header_{static_cast<Header *>(data)}, size_{size} {
+    }
+
+    [[noreturn]] static void fail(int error, char const *what) {
+        throw std::system_error(error, std::generic_category(), what);
+    }
+
+    static void *map(int fd, std::size_t size) {
+        void *data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        auto const error = errno;
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            fail(error, "Cannot map shared memory");
+        }
+        return data;
+    }
+
+   public:
+    // Creates the shared memory object `name`, e.g. "/my_queue", with `size` bytes. Fails if it already exists.
+    static SharedMemorySegment create(std::string const &name, std::size_t size) {
+        if (size < sizeof(Header)) {
+            throw std::invalid_argument("Shared memory segment too small");
+        }
+        int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd == -1) {
+            fail(errno, "Cannot create shared memory");
+        }
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            auto const error = errno;
+            ::close(fd);
+            ::shm_unlink(name.c_str());
+            fail(error, "Cannot resize shared memory");
+        }
+        void *data = map(fd, size);
+        ::new (data) Header(size);
+        return SharedMemorySegment(data, size);
+    }
+
+    // Attaches to the shared memory object `name` created by any process
+    static SharedMemorySegment open(std::string const &name) {
+        int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+        if (fd == -1) {
+            fail(errno, "Cannot open shared memory");
+        }
+        struct stat info {};
+        if (::fstat(fd, &info) != 0) {
+            auto const error = errno;
+            ::close(fd);
+            fail(error, "Cannot read shared memory");
+        }
+        auto const size = static_cast<std::size_t>(info.st_size);
+        if (size < sizeof(Header)) {
+            ::close(fd);
+            throw std::invalid_argument("Not a multiqueue shared memory segment");
+        }
+        SharedMemorySegment segment(map(fd, size), size);
+        if (segment.header_->magic != magic_value) {
+            throw std::invalid_argument("Not a multiqueue shared memory segment");
+        }
+        return segment;
+    }
+
+    // Removes the name, the memory is released once every process unmapped it
+    static void remove(std::string const &name) noexcept {
+        ::shm_unlink(name.c_str());
+    }
+
+    SharedMemorySegment(SharedMemorySegment &&other) noexcept
+        : header_{std::exchange(other.header_, nullptr)}, size_{std::exchange(other.size_, 0)} {
+    }
+
+    SharedMemorySegment(SharedMemorySegment const &) = delete;
+    SharedMemorySegment &operator=(SharedMemorySegment const &) = delete;
+    SharedMemorySegment &operator=(SharedMemorySegment &&) = delete;
+
+    ~SharedMemorySegment() {
+        if (header_ != nullptr) {
+            ::munmap(header_, size_);
+        }
+    }
+
+    template <typename T = std::byte>
+    [[nodiscard]] ShmAllocator<T> get_allocator() const noexcept {
+        return ShmAllocator<T>(header_->arena);
+    }
+
+    [[nodiscard]] SharedArena &arena() const noexcept {
+        return header_->arena;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        return size_;
+    }
+
+    // Constructs the root object in the segment and publishes it to `find`. Throws std::logic_error if there is one.
+    template <typename T, typename... Args>
+    T *construct(Args &&...args) {
+        if (header_->root) {
+            throw std::logic_error("The segment already holds an object");
+        }
+        auto alloc = get_allocator<T>();
+        auto p = alloc.allocate(1);
+        try {
+            ::new (static_cast<void *>(p.get())) T(std::forward<Args>(args)...);
+        } catch (...) {
+            alloc.deallocate(p, 1);
+            throw;
+        }
+        header_->root = reinterpret_cast<std::byte *>(p.get());
+        header_->ready.store(1, std::memory_order_release);
+        return p.get();
+    }
+
+    // The root object, or nullptr if it is not constructed yet
+    template <typename T>
+    [[nodiscard]] T *find() const noexcept {
+        if (header_->ready.load(std::memory_order_acquire) == 0) {
+            return nullptr;
+        }
+        return reinterpret_cast<T *>(header_->root.get());
+    }
+
+    // Destroys the root object, no process may use it anymore
+    template <typename T>
+    void destroy() {
+        auto *p = find<T>();
+        if (p == nullptr) {
+            return;
+        }
+        header_->ready.store(0, std::memory_order_relaxed);
+        header_->root = nullptr;
+        p->~T();
+        get_allocator<T>().deallocate(p, 1);
+    }
+};
+
+namespace shm {
+
+namespace detail {
+
+// Rejects the policy options that keep state in memory of a single process
+template <typename Policy>
+struct CheckedPolicy {
+    static_assert(!Policy::backoff_type::parks, "Parking uses process-private futexes");
+    static_assert(std::is_trivially_destructible_v<typename Policy::mode_type::SharedData>,
+                  "The shared data of the mode must not own memory");
+    using type = Policy;
+};
+
+}  // namespace detail
+
+template <typename Value, typename Compare>
+using PriorityQueue = BufferedPQ<Heap<Value, Compare, 8, std::vector<Value, ShmAllocator<Value>>>>;
+
+// Construct these in a SharedMemorySegment and pass `segment.get_allocator()` as allocator
+template <typename T, typename Compare = std::less<>, typename Policy = DefaultPolicy,
+          typename Sentinel = sentinel::Implicit<T, Compare>>
+using ValueMultiQueue =
+    multiqueue::ValueMultiQueue<T, Compare, typename detail::CheckedPolicy<Policy>::type, PriorityQueue<T, Compare>,
+                                Sentinel, ShmAllocator<PriorityQueue<T, Compare>>>;
+
+template <typename Key, typename T, typename Compare = std::less<>, typename Policy = DefaultPolicy,
+          typename Sentinel = sentinel::Implicit<Key, Compare>>
+using KeyValueMultiQueue = multiqueue::KeyValueMultiQueue<
+    Key, T, Compare, typename detail::CheckedPolicy<Policy>::type,
+    PriorityQueue<std::pair<Key, T>, utils::ValueCompare<std::pair<Key, T>, utils::PairFirst, Compare>>, Sentinel,
+    ShmAllocator<PriorityQueue<std::pair<Key, T>, utils::ValueCompare<std::pair<Key, T>, utils::PairFirst, Compare>>>>;
+
+}  // namespace shm
+
+}  // namespace multiqueue
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+// Opt-in event counters selected by `Policy::stats_type`. Every handle counts into its own `Counters` without
+// synchronization and merges them into the multiqueue when it is destroyed. With `None`, all counting calls are empty
+// and inline away.
+
+namespace multiqueue::stats {
+
+enum class Counter : std::size_t {
+    lock_attempts,
+    lock_failures,
+    // The top element of a locked queue was not the one its top key promised when the candidates were compared
+    stale_pops,
+    // The queue chosen for a pop was empty
+    empty_candidates,
+    scan_fallbacks,
+    // A sticky mode dropped its queues before the stickiness ran out, because a lock failed or a queue was empty
+    stickiness_resets,
+    buffer_refills,
+    buffer_flushes,
+    // A push that failed to lock its queue left the value in the queue's mailbox instead of retrying
+    mailbox_posts,
+    // A push that beat the top keys of the pop candidates was kept by the handle for its next pop
+    kept_pushes,
+    // A push that beat the top keys of the pop candidates was handed to a handle waiting in the elimination array
+    eliminated_pushes,
+    num_counters
+};
+
+inline constexpr std::size_t num_counters = static_cast<std::size_t>(Counter::num_counters);
+
+inline constexpr std::array<char const *, num_counters> counter_names = {
+    "lock_attempts",  "lock_failures",     "stale_pops",     "empty_candidates",
+    "scan_fallbacks", "stickiness_resets", "buffer_refills", "buffer_flushes",
+    "mailbox_posts",  "kept_pushes",       "eliminated_pushes"};
+
+struct None {
+    static constexpr bool enabled = false;
+
+    constexpr void add(Counter /*counter*/, std::uint64_t /*n*/ = 1) noexcept {
+    }
+};
+
+struct Counters {
+    static constexpr bool enabled = true;
+
+    std::array<std::uint64_t, num_counters> values{};
+
+    constexpr void add(Counter counter, std::uint64_t n = 1) noexcept {
+        values[static_cast<std::size_t>(counter)] += n;
+    }
+
+    [[nodiscard]] constexpr std::uint64_t operator[](Counter counter) const noexcept {
+        return values[static_cast<std::size_t>(counter)];
+    }
+
+    constexpr Counters &operator+=(Counters const &other) noexcept {
+        for (std::size_t i = 0; i < num_counters; ++i) {
+            values[i] += other.values[i];
+        }
+        return *this;
+    }
+};
+
+// The counters of all destroyed handles
+template <typename Stats>
+class Aggregate {
+    static_assert(std::is_same_v<Stats, None>, "Unsupported stats type");
+
+   public:
+    void merge(None const & /*stats*/) noexcept {
+    }
+
+    [[nodiscard]] None load() const noexcept {
+        return {};
+    }
+};
+
+template <>
+class Aggregate<Counters> {
+    std::array<std::atomic_uint64_t, num_counters> values_{};
+
+   public:
+    void merge(Counters const &stats) noexcept {
+        for (std::size_t i = 0; i < num_counters; ++i) {
+            values_[i].fetch_add(stats.values[i], std::memory_order_relaxed);
+        }
+    }
+
+    [[nodiscard]] Counters load() const noexcept {
+        Counters stats;
+        for (std::size_t i = 0; i < num_counters; ++i) {
+            stats.values[i] = values_[i].load(std::memory_order_relaxed);
+        }
+        return stats;
+    }
+};
+
+// Priority queues opt into counting by providing `push(value, stats)` and `pop(stats)`
+template <typename PriorityQueue, typename Stats, typename = void>
+struct counts_events : std::false_type {};
+
+template <typename PriorityQueue, typename Stats>
+struct counts_events<PriorityQueue, Stats,
+                     std::void_t<decltype(std::declval<PriorityQueue &>().pop(std::declval<Stats &>()))>>
+    : std::true_type {};
+
+}  // namespace multiqueue::stats
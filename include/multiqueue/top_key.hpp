@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Storage of the top key a guard publishes to threads comparing pop candidates. Only the lock holder of the guard
+// stores, any thread loads without locking.
+
+namespace multiqueue {
+
+// For keys with a lock-free std::atomic
+template <typename Key>
+class AtomicTopKey {
+    std::atomic<Key> key_;
+
+   public:
+    explicit AtomicTopKey(Key const& key) noexcept : key_(key) {
+    }
+
+    [[nodiscard]] Key load() const noexcept {
+        return key_.load(std::memory_order_relaxed);
+    }
+
+    void store(Key const& key) noexcept {
+        key_.store(key, std::memory_order_relaxed);
+    }
+};
+
+// For trivially copyable keys without a lock-free std::atomic, e.g. 128-bit integers or small structs. The key is
+// copied word by word into two copies under a sequence counter, like a latch: while one copy is written, loads read the
+// other one, which holds the previous key. A store in progress thus never blocks a load nor makes it report another
+// key, e.g. an empty queue. A load only retries if a store completed while it read.
+template <typename Key>
+class SeqlockTopKey {
+    static_assert(std::is_trivially_copyable_v<Key>, "The key must be trivially copyable");
+    static_assert(std::is_default_constructible_v<Key>, "The key must be default-constructible");
+
+    using word_type = std::uint64_t;
+    static constexpr std::size_t num_words = (sizeof(Key) + sizeof(word_type) - 1) / sizeof(word_type);
+
+    std::atomic_uint32_t seq_{0};
+    std::array<std::array<std::atomic<word_type>, num_words>, 2> copies_{};
+
+    void write_words(std::size_t copy, Key const& key) noexcept {
+        std::array<word_type, num_words> buffer{};
+        std::memcpy(buffer.data(), &key, sizeof(Key));
+        for (std::size_t i = 0; i < num_words; ++i) {
+            copies_[copy][i].store(buffer[i], std::memory_order_relaxed);
+        }
+    }
+
+   public:
+    explicit SeqlockTopKey(Key const& key) noexcept {
+        write_words(0, key);
+        write_words(1, key);
+    }
+
+    // An odd sequence number marks the first copy as being written, an even one the second
+    [[nodiscard]] Key load() const noexcept {
+        std::array<word_type, num_words> buffer;
+        while (true) {
+            auto const seq = seq_.load(std::memory_order_acquire);
+            auto const& copy = copies_[seq & 1U];
+            for (std::size_t w = 0; w < num_words; ++w) {
+                buffer[w] = copy[w].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq_.load(std::memory_order_relaxed) == seq) {
+                Key key;
+                std::memcpy(static_cast<void*>(&key), buffer.data(), sizeof(Key));
+                return key;
+            }
+        }
+    }
+
+    // Single writer, the lock holder of the guard
+    void store(Key const& key) noexcept {
+        auto const seq = seq_.load(std::memory_order_relaxed);
+        seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        write_words(0, key);
+        seq_.store(seq + 2, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_release);
+        write_words(1, key);
+    }
+};
+
+template <typename Key>
+using TopKey = std::conditional_t<std::atomic<Key>::is_always_lock_free, AtomicTopKey<Key>, SeqlockTopKey<Key>>;
+
+}  // namespace multiqueue
@@ -0,0 +1,198 @@
+#pragma once
+
+#include "multiqueue/build_config.hpp"
+#include "multiqueue/sentinel.hpp"
+#include "multiqueue/utils.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+// A dense copy of the top keys of all queues, selected by `Policy::shadow_top_keys`. The guards keep it up to date in
+// `pushed()` and `popped()` (see ShadowingPQGuard), so finding the best of many queues reads a few cache lines instead
+// of one line per queue. With AVX2 and 64-bit integer keys under their implicit sentinel, ranges of keys are compared
+// four at a time. The shadow is allocated with the allocator of the multiqueue, so it lives in the same memory resource
+// or shared memory segment as the guards.
+
+namespace multiqueue {
+
+template <typename Key, typename Compare, typename Sentinel, typename Allocator = std::allocator<Key>>
+class TopKeyShadow {
+   public:
+    using key_type = Key;
+    using slot_type = std::atomic<key_type>;
+    // Points to a slot from a guard, an offset pointer if the allocator places the shadow in shared memory
+    using slot_pointer = typename std::allocator_traits<
+        typename std::allocator_traits<Allocator>::template rebind_alloc<slot_type>>::pointer;
+
+    static constexpr std::size_t keys_per_line =
+        std::max(std::size_t{1}, build_config::l1_cache_line_size / sizeof(slot_type));
+
+   private:
+    static_assert(std::atomic<key_type>::is_always_lock_free, "The top key shadow requires a lock-free key type");
+
+    struct alignas(build_config::l1_cache_line_size) Line {
+        std::array<slot_type, keys_per_line> keys;
+    };
+
+    // Without a sentinel to handle, the best key is the minimum or maximum of the raw integers
+    static constexpr bool is_min = std::is_same_v<Compare, std::greater<>> || std::is_same_v<Compare, std::greater<Key>>;
+    static constexpr bool is_max = std::is_same_v<Compare, std::less<>> || std::is_same_v<Compare, std::less<Key>>;
+    static constexpr bool vectorize = std::is_integral_v<key_type> && sizeof(key_type) == 8 &&
+        std::is_same_v<Sentinel, sentinel::Implicit<Key, Compare>> && (is_min || is_max);
+
+    using line_allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<Line>;
+    using line_pointer = typename std::allocator_traits<line_allocator_type>::pointer;
+
+    [[no_unique_address]] line_allocator_type alloc_;
+    line_pointer lines_{nullptr};
+    std::size_t size_;
+
+    static constexpr std::size_t num_lines(std::size_t size) noexcept {
+        return (size + keys_per_line - 1) / keys_per_line;
+    }
+
+    [[nodiscard]] Line* lines() const noexcept {
+        return utils::to_address(lines_);
+    }
+
+    std::pair<std::size_t, key_type> best_scalar(std::size_t first, std::size_t last, Compare const& comp) const noexcept {
+        std::pair<std::size_t, key_type> best{first, load(first)};
+        for (auto i = first + 1; i < last; ++i) {
+            auto key = load(i);
+            if (Sentinel::compare(comp, best.second, key)) {
+                best = {i, key};
+            }
+        }
+        return best;
+    }
+
+#if defined(__AVX2__)
+    // The keys are read with relaxed atomic loads like in the scalar path and only compared in vector registers
+    std::pair<std::size_t, key_type> best_vectorized(std::size_t first, std::size_t last,
+                                                      Compare const& comp) const noexcept {
+        constexpr std::size_t lanes = 4;
+        if (last - first < 2 * lanes) {
+            return best_scalar(first, last, comp);
+        }
+        // AVX2 only compares signed integers, so unsigned keys have their sign bit flipped
+        auto const bias = _mm256_set1_epi64x(std::is_signed_v<key_type> ? 0 : std::numeric_limits<long long>::min());
+        auto best = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(Sentinel::sentinel())), bias);
+        auto best_index = _mm256_set1_epi64x(static_cast<long long>(first));
+        auto index = _mm256_setr_epi64x(static_cast<long long>(first), static_cast<long long>(first + 1),
+                                        static_cast<long long>(first + 2), static_cast<long long>(first + 3));
+        auto const step = _mm256_set1_epi64x(static_cast<long long>(lanes));
+        auto i = first;
+        for (; i + lanes <= last; i += lanes) {
+            auto v = _mm256_xor_si256(
+                _mm256_setr_epi64x(static_cast<long long>(load(i)), static_cast<long long>(load(i + 1)),
+                                   static_cast<long long>(load(i + 2)), static_cast<long long>(load(i + 3))),
+                bias);
+            auto better = is_min ? _mm256_cmpgt_epi64(best, v) : _mm256_cmpgt_epi64(v, best);
+            best = _mm256_blendv_epi8(best, v, better);
+            best_index = _mm256_blendv_epi8(best_index, index, better);
+            index = _mm256_add_epi64(index, step);
+        }
+        std::array<long long, lanes> lane_keys{};
+        std::array<long long, lanes> lane_indices{};
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lane_keys.data()), _mm256_xor_si256(best, bias));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lane_indices.data()), best_index);
+        std::pair<std::size_t, key_type> result{static_cast<std::size_t>(lane_indices[0]),
+                                                static_cast<key_type>(lane_keys[0])};
+        for (std::size_t l = 1; l < lanes; ++l) {
+            if (comp(result.second, static_cast<key_type>(lane_keys[l]))) {
+                result = {static_cast<std::size_t>(lane_indices[l]), static_cast<key_type>(lane_keys[l])};
+            }
+        }
+        for (; i < last; ++i) {
+            auto key = load(i);
+            if (comp(result.second, key)) {
+                result = {i, key};
+            }
+        }
+        return result;
+    }
+#endif
+
+   public:
+    explicit TopKeyShadow(std::size_t size, Allocator const& alloc = Allocator())
+        : alloc_(alloc),
+          lines_(std::allocator_traits<line_allocator_type>::allocate(alloc_, num_lines(size))),
+          size_(size) {
+        for (auto* it = lines(); it != lines() + num_lines(size_); ++it) {
+            std::allocator_traits<line_allocator_type>::construct(alloc_, it);
+        }
+        for (std::size_t i = 0; i < size_; ++i) {
+            slot(i).store(Sentinel::sentinel(), std::memory_order_relaxed);
+        }
+    }
+
+    TopKeyShadow(TopKeyShadow const&) = delete;
+    TopKeyShadow& operator=(TopKeyShadow const&) = delete;
+
+    ~TopKeyShadow() noexcept {
+        for (auto* it = lines(); it != lines() + num_lines(size_); ++it) {
+            std::allocator_traits<line_allocator_type>::destroy(alloc_, it);
+        }
+        std::allocator_traits<line_allocator_type>::deallocate(alloc_, lines_, num_lines(size_));
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        return size_;
+    }
+
+    [[nodiscard]] std::size_t memory_usage() const noexcept {
+        return num_lines(size_) * sizeof(Line);
+    }
+
+    [[nodiscard]] slot_type& slot(std::size_t index) noexcept {
+        assert(index < size_);
+        return lines()[index / keys_per_line].keys[index % keys_per_line];
+    }
+
+    [[nodiscard]] slot_type const& slot(std::size_t index) const noexcept {
+        assert(index < size_);
+        return lines()[index / keys_per_line].keys[index % keys_per_line];
+    }
+
+    [[nodiscard]] key_type load(std::size_t index) const noexcept {
+        return slot(index).load(std::memory_order_relaxed);
+    }
+
+    // Index and key of the best top key in [first, last), the key is the sentinel if all queues in the range are empty
+    [[nodiscard]] std::pair<std::size_t, key_type> best(std::size_t first, std::size_t last,
+                                                        Compare const& comp) const noexcept {
+        assert(first < last && last <= size_);
+#if defined(__AVX2__)
+        if constexpr (vectorize) {
+            return best_vectorized(first, last, comp);
+        }
+#endif
+        return best_scalar(first, last, comp);
+    }
+};
+
+// Stands in for the shadow if `Policy::shadow_top_keys` is not set
+struct NoTopKeyShadow {
+    template <typename Allocator>
+    explicit NoTopKeyShadow(std::size_t /*size*/, Allocator const& /*alloc*/) noexcept {
+    }
+
+    [[nodiscard]] static constexpr std::size_t memory_usage() noexcept {
+        return 0;
+    }
+};
+
+}  // namespace multiqueue
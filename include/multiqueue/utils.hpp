@@ -1,9 +1,58 @@
 #pragma once
 
+#include "multiqueue/build_config.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <chrono>
+#include <cstdint>
 #include <utility>
 
 namespace multiqueue::utils {
 
+// Hint the cache to load the line containing `p`. Set `write` if the line is going to be modified.
+template <bool write = false>
+inline void prefetch(void const *p) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+    if constexpr (build_config::prefetch) {
+        __builtin_prefetch(p, write ? 1 : 0, 3);
+    }
+#else
+    (void)p;
+#endif
+}
+
+// Tell the processor that we are in a spin loop
+inline void pause() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// A cheap timestamp for measuring short intervals: the time stamp counter on x86, nanoseconds elsewhere
+inline std::uint64_t timestamp() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+// The raw pointer held by an allocator's pointer type, e.g. an offset pointer into shared memory
+template <typename T>
+constexpr T *to_address(T *p) noexcept {
+    return p;
+}
+
+template <typename Pointer>
+auto to_address(Pointer const &p) noexcept {
+    return to_address(p.operator->());
+}
+
 struct Identity {
     template <typename T>
     static constexpr T &&get(T &&t) noexcept {
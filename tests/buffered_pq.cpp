@@ -4,7 +4,9 @@
 #include "catch2/catch_template_test_macros.hpp"
 #include "catch2/generators/catch_generators_all.hpp"
 
+#include <algorithm>
 #include <array>
+#include <iterator>
 #include <list>
 #include <queue>
 #include <random>
@@ -186,3 +188,53 @@ TEST_CASE("buffered pq works with randomized workloads", "[buffered_pq][workload
         REQUIRE(ref_pq.empty());
     }
 }
+
+TEST_CASE("buffered pq extracts all elements", "[buffered_pq][extract]") {
+    using pq_t = multiqueue::BufferedPQ<multiqueue::Heap<int, std::greater<>>>;
+
+    auto pq = pq_t{};
+    for (int n = 0; n < 1000; ++n) {
+        pq.push((n * 37) % 1000);
+    }
+    pq.pop();
+
+    std::vector<int> values;
+    pq.extract(std::back_inserter(values));
+    REQUIRE(pq.empty());
+    REQUIRE(pq.size() == 0);
+    std::sort(values.begin(), values.end());
+    REQUIRE(values.size() == 999);
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        REQUIRE(values[i] == static_cast<int>(i) + 1);
+    }
+
+    pq.push(5);
+    pq.push(3);
+    REQUIRE(pq.top() == 3);
+}
+
+TEST_CASE("buffered pq pops in bulk while a predicate holds", "[buffered_pq][bulk]") {
+    using pq_t = multiqueue::BufferedPQ<multiqueue::Heap<int, std::greater<>>>;
+
+    auto pq = pq_t{};
+    for (int n = 0; n < 1000; ++n) {
+        pq.push((n * 37) % 1000);
+    }
+    auto below = [](int bound) { return [bound](int v) { return v < bound; }; };
+
+    std::vector<int> values;
+    // Spans several refills of the deletion buffer
+    REQUIRE(pq.pop_while(below(100), 1000, std::back_inserter(values)) == 100);
+    REQUIRE(pq.top() == 100);
+    REQUIRE(pq.pop_while(below(50), 1000, std::back_inserter(values)) == 0);
+    // Stops at the maximum count in the middle of the deletion buffer
+    REQUIRE(pq.pop_while(below(200), 7, std::back_inserter(values)) == 7);
+    REQUIRE(pq.top() == 107);
+    REQUIRE(pq.size() == 893);
+    REQUIRE(values.size() == 107);
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        REQUIRE(values[i] == static_cast<int>(i));
+    }
+    REQUIRE(pq.pop_while(below(1000), 1000, std::back_inserter(values)) == 893);
+    REQUIRE(pq.empty());
+}
@@ -1,6 +1,1341 @@
+#include "multiqueue/checkpoint.hpp"
+#include "multiqueue/mailbox_pq_guard.hpp"
+#include "multiqueue/memory_resource.hpp"
+#include "multiqueue/modes/stick_mark.hpp"
+#include "multiqueue/modes/stick_random.hpp"
+#include "multiqueue/modes/stick_swap.hpp"
+#include "multiqueue/multiqueue.hpp"
+#include "multiqueue/profiling_pq_guard.hpp"
+#include "multiqueue/shared_memory.hpp"
+#include "multiqueue/top_key.hpp"
+#include "multiqueue/top_key_shadow.hpp"
+
+#include "catch2/catch_template_test_macros.hpp"
 #include "catch2/catch_test_macros.hpp"
 
-TEST_CASE("multiqueue TODO", "[multiqueue][.shouldfail]") {
-  INFO("No tests for multiqueue yet!");
-  REQUIRE(false);
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory_resource>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using mq_t = multiqueue::ValueMultiQueue<int, std::greater<>>;
+
+struct StickSwapPolicy : multiqueue::DefaultPolicy {
+    using mode_type = multiqueue::mode::StickSwap<2>;
+};
+
+struct StatsPolicy : multiqueue::DefaultPolicy {
+    using stats_type = multiqueue::stats::Counters;
+};
+
+struct ProfilingPolicy : multiqueue::DefaultPolicy {
+    static constexpr bool profile_guards = true;
+};
+
+struct ParkingPolicy : multiqueue::DefaultPolicy {
+    using backoff_type = multiqueue::backoff::Park<1, 50>;
+};
+
+struct SeparateTopKeyPolicy : multiqueue::DefaultPolicy {
+    static constexpr bool separate_top_key = true;
+};
+
+struct ShadowPolicy : multiqueue::DefaultPolicy {
+    using mode_type = multiqueue::mode::Random<8>;
+    static constexpr bool shadow_top_keys = true;
+};
+
+template <typename Mode>
+struct MailboxPolicy : multiqueue::DefaultPolicy {
+    using mode_type = Mode;
+    static constexpr std::size_t push_mailbox_size = 2;
+};
+
+struct MailboxProfilingPolicy : MailboxPolicy<multiqueue::mode::Random<2>> {
+    static constexpr bool profile_guards = true;
+};
+
+template <typename Mode, std::size_t EliminationSlots = 0>
+struct EliminationPolicy : multiqueue::DefaultPolicy {
+    using mode_type = Mode;
+    using stats_type = multiqueue::stats::Counters;
+    static constexpr bool eliminate_pushes = true;
+    static constexpr std::size_t elimination_slots = EliminationSlots;
+};
+
+// 128 bit key without a lock-free std::atomic, the default constructed key is the sentinel
+struct WideKey {
+    std::uint64_t time = 0;
+    std::uint64_t id = 0;
+
+    friend bool operator==(WideKey const &lhs, WideKey const &rhs) noexcept {
+        return lhs.time == rhs.time && lhs.id == rhs.id;
+    }
+
+    friend bool operator!=(WideKey const &lhs, WideKey const &rhs) noexcept {
+        return !(lhs == rhs);
+    }
+
+    friend bool operator>(WideKey const &lhs, WideKey const &rhs) noexcept {
+        return lhs.time > rhs.time || (lhs.time == rhs.time && lhs.id > rhs.id);
+    }
+};
+
+// Counts the bytes currently allocated through it
+class CountingResource : public std::pmr::memory_resource {
+    std::atomic_size_t allocated_{0};
+
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+        allocated_ += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override {
+        allocated_ -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    [[nodiscard]] bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override {
+        return this == &other;
+    }
+
+   public:
+    [[nodiscard]] std::size_t allocated() const noexcept {
+        return allocated_.load();
+    }
+};
+
+template <typename Handle>
+std::vector<int> pop_all(Handle &handle) {
+    std::vector<int> values;
+    while (auto v = handle.try_pop()) {
+        values.push_back(*v);
+    }
+    std::sort(values.begin(), values.end());
+    return values;
+}
+
+}  // namespace
+
+TEST_CASE("multiqueue supports basic operations", "[multiqueue][basic]") {
+    auto mq = mq_t{4};
+    auto handle = mq.get_handle();
+
+    REQUIRE(mq.num_pqs() == 4);
+    REQUIRE(mq.max_num_pqs() == 4);
+    REQUIRE_FALSE(handle.try_pop());
+
+    for (int n = 0; n < 1000; ++n) {
+        handle.push(n);
+    }
+    auto values = pop_all(handle);
+    REQUIRE(values.size() == 1000);
+    for (int n = 0; n < 1000; ++n) {
+        REQUIRE(values[static_cast<std::size_t>(n)] == n);
+    }
+}
+
+TEST_CASE("multiqueue works with the top key on a separate cache line", "[multiqueue][basic]") {
+    auto mq = multiqueue::ValueMultiQueue<int, std::greater<>, SeparateTopKeyPolicy>{4};
+    auto handle = mq.get_handle();
+
+    for (int n = 999; n >= 0; --n) {
+        handle.push(n);
+    }
+    std::vector<int> values;
+    while (auto v = handle.try_pop()) {
+        values.push_back(*v);
+    }
+    std::sort(values.begin(), values.end());
+    REQUIRE(values.size() == 1000);
+    for (int n = 0; n < 1000; ++n) {
+        REQUIRE(values[static_cast<std::size_t>(n)] == n);
+    }
+}
+
+TEST_CASE("multiqueue can change the number of queues", "[multiqueue][resize]") {
+    auto mq = mq_t{16};
+    auto handle = mq.get_handle();
+
+    SECTION("invalid sizes are rejected") {
+        REQUIRE_THROWS_AS(mq.set_num_pqs(0), std::invalid_argument);
+        REQUIRE_THROWS_AS(mq.set_num_pqs(17), std::invalid_argument);
+        // Fewer queues than pop candidates
+        REQUIRE_THROWS_AS(mq.set_num_pqs(1), std::invalid_argument);
+        REQUIRE(mq.num_pqs() == 16);
+        auto wide_mq = multiqueue::ValueMultiQueue<int, std::greater<>, ShadowPolicy>{16};
+        REQUIRE_THROWS_AS(wide_mq.set_num_pqs(7), std::invalid_argument);
+        wide_mq.set_num_pqs(8);
+        REQUIRE(wide_mq.num_pqs() == 8);
+    }
+
+    SECTION("shrinking keeps all elements") {
+        for (int n = 0; n < 1000; ++n) {
+            handle.push(n);
+        }
+        mq.set_num_pqs(2);
+        REQUIRE(mq.num_pqs() == 2);
+        auto values = pop_all(handle);
+        REQUIRE(values.size() == 1000);
+        for (int n = 0; n < 1000; ++n) {
+            REQUIRE(values[static_cast<std::size_t>(n)] == n);
+        }
+    }
+
+    SECTION("removed queues are used again after growing") {
+        mq.set_num_pqs(2);
+        for (int n = 0; n < 1000; ++n) {
+            handle.push(n);
+        }
+        mq.set_num_pqs(16);
+        REQUIRE(mq.num_pqs() == 16);
+        for (int n = 1000; n < 2000; ++n) {
+            handle.push(n);
+        }
+        mq.set_num_pqs(4);
+        auto values = pop_all(handle);
+        REQUIRE(values.size() == 2000);
+        for (int n = 0; n < 2000; ++n) {
+            REQUIRE(values[static_cast<std::size_t>(n)] == n);
+        }
+    }
+}
+
+TEST_CASE("multiqueue reserves storage in parallel", "[multiqueue][reserve][concurrent]") {
+    static constexpr int num_threads = 4;
+    auto mq = mq_t{8};
+
+    REQUIRE_THROWS_AS(mq.reserve(1000, 4, 4), std::invalid_argument);
+    REQUIRE_THROWS_AS(mq.reserve(1000, 0, 0), std::invalid_argument);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            auto handle = mq.get_handle();
+            for (int i = 0; i < 100; ++i) {
+                handle.push(t * 100 + i);
+            }
+            mq.reserve(100000, static_cast<std::size_t>(t), num_threads);
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    auto handle = mq.get_handle();
+    auto values = pop_all(handle);
+    REQUIRE(values.size() == 400);
+    for (int n = 0; n < 400; ++n) {
+        REQUIRE(values[static_cast<std::size_t>(n)] == n);
+    }
+}
+
+TEST_CASE("multiqueue reports and releases its memory", "[multiqueue][memory]") {
+    auto mq = mq_t{4};
+    auto const initial = mq.memory_usage();
+    REQUIRE(initial.guards >= 4 * sizeof(int));
+    REQUIRE(initial.heaps == 0);
+
+    auto handle = mq.get_handle();
+    for (int n = 0; n < 10000; ++n) {
+        handle.push(n);
+    }
+    auto const peak = mq.memory_usage();
+    REQUIRE(peak.guards == initial.guards);
+    REQUIRE(peak.heaps >= 10000 * sizeof(int) - 4 * 32 * sizeof(int));
+
+    // Filled queues are kept
+    mq.trim(0.25);
+    REQUIRE(mq.memory_usage().heaps == peak.heaps);
+
+    for (int n = 0; n < 9000; ++n) {
+        REQUIRE(handle.try_pop());
+    }
+    mq.trim(0.25);
+    auto const trimmed = mq.memory_usage();
+    REQUIRE(trimmed.heaps < peak.heaps);
+    REQUIRE(trimmed.heaps >= 1000 * sizeof(int) - 4 * 32 * sizeof(int));
+
+    REQUIRE(pop_all(handle).size() == 1000);
+    mq.shrink_to_fit();
+    REQUIRE(mq.memory_usage().heaps == 0);
+    REQUIRE(mq.memory_usage().total() == initial.total());
+}
+
+TEST_CASE("multiqueue can be trimmed while in use", "[multiqueue][memory][concurrent]") {
+    static constexpr int num_threads = 4;
+    static constexpr int elements_per_thread = 10000;
+    auto mq = mq_t{8};
+    std::atomic_bool done = false;
+    std::size_t min_usage = std::numeric_limits<std::size_t>::max();
+    std::thread trimmer([&] {
+        while (!done.load()) {
+            mq.trim(0.5);
+            min_usage = std::min(min_usage, mq.memory_usage().total());
+        }
+    });
+    std::vector<std::thread> threads;
+    std::vector<std::vector<int>> popped(num_threads);
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            auto handle = mq.get_handle();
+            for (int i = 0; i < elements_per_thread; ++i) {
+                handle.push(t * elements_per_thread + i);
+                if (i % 2 == 1) {
+                    if (auto v = handle.try_pop()) {
+                        popped[static_cast<std::size_t>(t)].push_back(*v);
+                    }
+                }
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    done = true;
+    trimmer.join();
+    REQUIRE(min_usage >= mq.memory_usage().guards);
+
+    auto handle = mq.get_handle();
+    auto values = pop_all(handle);
+    for (auto const &out : popped) {
+        values.insert(values.end(), out.begin(), out.end());
+    }
+    std::sort(values.begin(), values.end());
+    REQUIRE(values.size() == static_cast<std::size_t>(num_threads * elements_per_thread));
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        REQUIRE(values[i] == static_cast<int>(i));
+    }
+}
+
+TEST_CASE("multiqueue reports its size", "[multiqueue][size]") {
+    auto mq = mq_t{4};
+    REQUIRE(mq.empty());
+    REQUIRE(mq.size() == 0);
+
+    auto handle = mq.get_handle();
+    for (int n = 0; n < 1000; ++n) {
+        handle.push(n);
+    }
+    REQUIRE_FALSE(mq.empty());
+    REQUIRE(mq.size() == 1000);
+
+    mq.set_num_pqs(2);
+    REQUIRE(mq.size() == 1000);
+    for (int n = 0; n < 600; ++n) {
+        REQUIRE(handle.try_pop());
+    }
+    REQUIRE(mq.size() == 400);
+    mq.set_num_pqs(4);
+    REQUIRE(pop_all(handle).size() == 400);
+    REQUIRE(mq.empty());
+    REQUIRE(mq.size() == 0);
+}
+
+TEST_CASE("multiqueue is not empty after a synchronized push", "[multiqueue][size][concurrent]") {
+    static constexpr int num_rounds = 1000;
+    auto mq = mq_t{8};
+    std::atomic_int pushed = 0;
+    std::atomic_int checked = 0;
+    std::thread producer([&] {
+        auto handle = mq.get_handle();
+        for (int n = 0; n < num_rounds; ++n) {
+            handle.push(n);
+            pushed.store(n + 1, std::memory_order_release);
+            while (checked.load(std::memory_order_acquire) != n + 1) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    auto handle = mq.get_handle();
+    bool missed = false;
+    for (int n = 0; n < num_rounds; ++n) {
+        while (pushed.load(std::memory_order_acquire) != n + 1) {
+            std::this_thread::yield();
+        }
+        missed = missed || mq.empty();
+        missed = missed || !handle.try_pop();
+        checked.store(n + 1, std::memory_order_release);
+    }
+    producer.join();
+    REQUIRE_FALSE(missed);
+    REQUIRE(mq.empty());
+}
+
+TEST_CASE("multiqueue peeks at the best key without locking", "[multiqueue][peek]") {
+    using profiling_mq_t = multiqueue::ValueMultiQueue<int, std::greater<>, ProfilingPolicy>;
+    auto mq = profiling_mq_t{4};
+    auto handle = mq.get_handle();
+    REQUIRE(mq.approx_min_key() == mq.sentinel());
+    REQUIRE(handle.peek_key() == mq.sentinel());
+    for (int n = 100; n > 0; --n) {
+        handle.push(n);
+    }
+    auto const profiles = mq.guard_profiles();
+    REQUIRE(mq.approx_min_key() == 1);
+    for (int i = 0; i < 100; ++i) {
+        // The top key of some queue, all of which hold elements
+        auto const key = handle.peek_key();
+        REQUIRE(key >= 1);
+        REQUIRE(key <= 100);
+    }
+    for (std::size_t i = 0; i < profiles.size(); ++i) {
+        REQUIRE(mq.guard_profiles()[i].lock_acquisitions == profiles[i].lock_acquisitions);
+    }
+    auto values = pop_all(handle);
+    REQUIRE(values.size() == 100);
+    REQUIRE(mq.approx_min_key() == mq.sentinel());
+}
+
+TEST_CASE("multiqueue peeks at the top key shadow", "[multiqueue][peek][shadow]") {
+    auto mq = multiqueue::ValueMultiQueue<int, std::greater<>, ShadowPolicy>{16};
+    auto handle = mq.get_handle();
+    for (int n = 1000; n > 0; --n) {
+        handle.push(n);
+    }
+    REQUIRE(mq.approx_min_key() == 1);
+    mq.set_num_pqs(8);
+    REQUIRE(mq.approx_min_key() == 1);
+    REQUIRE(handle.peek_key() >= 1);
+}
+
+TEST_CASE("multiqueue pops only elements within a key bound", "[multiqueue][bounded]") {
+    using profiling_mq_t = multiqueue::ValueMultiQueue<int, std::greater<>, ProfilingPolicy>;
+    auto mq = profiling_mq_t{4};
+    auto handle = mq.get_handle();
+    for (int n = 1; n <= 100; ++n) {
+        handle.push(n);
+    }
+    auto lock_acquisitions = [&mq] {
+        std::uint64_t n = 0;
+        for (auto const &profile : mq.guard_profiles()) {
+            n += profile.lock_acquisitions;
+        }
+        return n;
+    };
+
+    // No top key is within the bound, so no queue is locked
+    auto const locks = lock_acquisitions();
+    REQUIRE_FALSE(handle.try_pop_if(0).has_value());
+    std::vector<int> values;
+    REQUIRE(handle.try_pop_bulk_until(0, std::back_inserter(values)) == 0);
+    REQUIRE(lock_acquisitions() == locks);
+
+    auto v = handle.try_pop_if(10);
+    REQUIRE(v.has_value());
+    REQUIRE(*v <= 10);
+    values.push_back(*v);
+    // Every bulk pop takes a sorted run from one queue
+    while (true) {
+        std::vector<int> run;
+        auto const n = handle.try_pop_bulk_until(30, std::back_inserter(run), 8);
+        if (n == 0) {
+            break;
+        }
+        REQUIRE(n <= 8);
+        REQUIRE(run.size() == n);
+        REQUIRE(std::is_sorted(run.begin(), run.end()));
+        values.insert(values.end(), run.begin(), run.end());
+    }
+    std::sort(values.begin(), values.end());
+    REQUIRE(values.size() == 30);
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        REQUIRE(values[i] == static_cast<int>(i) + 1);
+    }
+    REQUIRE(mq.size() == 70);
+    REQUIRE(mq.approx_min_key() == 31);
+}
+
+TEST_CASE("multiqueue drains all elements", "[multiqueue][drain]") {
+    auto mq = mq_t{8};
+    auto handle = mq.get_handle();
+    for (int n = 0; n < 10000; ++n) {
+        handle.push((n * 7919) % 10000);
+    }
+    mq.set_num_pqs(5);
+
+    SECTION("unordered into a random access range") {
+        std::vector<int> values(mq.size());
+        REQUIRE(mq.drain(values.begin(), 3) == values.end());
+        std::sort(values.begin(), values.end());
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            REQUIRE(values[i] == static_cast<int>(i));
+        }
+    }
+    SECTION("unordered into a back inserter") {
+        std::vector<int> values;
+        mq.drain(std::back_inserter(values));
+        std::sort(values.begin(), values.end());
+        REQUIRE(values.size() == 10000);
+        REQUIRE(values.back() == 9999);
+    }
+    SECTION("sorted into a random access range") {
+        std::vector<int> values(mq.size());
+        REQUIRE(mq.drain_sorted(values.begin(), 3) == values.end());
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            REQUIRE(values[i] == static_cast<int>(i));
+        }
+    }
+    SECTION("sorted into a back inserter") {
+        std::vector<int> values;
+        mq.drain_sorted(std::back_inserter(values), 4);
+        REQUIRE(values.size() == 10000);
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            REQUIRE(values[i] == static_cast<int>(i));
+        }
+    }
+    REQUIRE(mq.empty());
+    REQUIRE_FALSE(handle.try_pop());
+    handle.push(1);
+    REQUIRE(handle.try_pop() == 1);
+}
+
+TEST_CASE("multiqueue drains sorted with many equal keys", "[multiqueue][drain]") {
+    auto mq = multiqueue::KeyValueMultiQueue<int, int, std::greater<>>{4};
+    auto handle = mq.get_handle();
+    for (int n = 0; n < 5000; ++n) {
+        handle.push({n % 3, n});
+    }
+    std::vector<std::pair<int, int>> values;
+    mq.drain_sorted(std::back_inserter(values), 8);
+    REQUIRE(values.size() == 5000);
+    REQUIRE(std::is_sorted(values.begin(), values.end(),
+                           [](auto const &lhs, auto const &rhs) { return lhs.first < rhs.first; }));
+}
+
+TEST_CASE("multiqueue restores a checkpoint", "[multiqueue][checkpoint]") {
+    auto const path = (std::filesystem::temp_directory_path() / "multiqueue_checkpoint_test").string();
+    auto mq = mq_t{8};
+    auto handle = mq.get_handle();
+    for (int n = 0; n < 10000; ++n) {
+        handle.push((n * 7919) % 10000);
+    }
+    for (int n = 0; n < 100; ++n) {
+        REQUIRE(handle.try_pop());
+    }
+    mq.set_num_pqs(6);
+    multiqueue::save_checkpoint(mq, path, 3);
+    REQUIRE(mq.size() == 9900);
+
+    auto restored = mq_t{8};
+    restored.set_num_pqs(7);
+    auto restored_handle = restored.get_handle();
+    restored_handle.push(-1);
+    multiqueue::restore_checkpoint(restored, path, 2);
+    REQUIRE(restored.size() == 9900);
+    std::vector<int> expected;
+    mq.drain(std::back_inserter(expected));
+    std::sort(expected.begin(), expected.end());
+    REQUIRE(pop_all(restored_handle) == expected);
+
+    auto too_small = mq_t{4};
+    REQUIRE_THROWS_AS(multiqueue::restore_checkpoint(too_small, path), std::invalid_argument);
+    auto wrong_type = multiqueue::ValueMultiQueue<long, std::greater<>>{8};
+    REQUIRE_THROWS_AS(multiqueue::restore_checkpoint(wrong_type, path), std::invalid_argument);
+    std::filesystem::remove(path);
+    REQUIRE_THROWS_AS(multiqueue::restore_checkpoint(restored, path), std::system_error);
+}
+
+TEST_CASE("multiqueue restores a checkpoint of key/value pairs", "[multiqueue][checkpoint]") {
+    using kv_mq_t = multiqueue::KeyValueMultiQueue<int, int, std::greater<>>;
+    auto const path = (std::filesystem::temp_directory_path() / "multiqueue_kv_checkpoint_test").string();
+    auto mq = kv_mq_t{4};
+    auto handle = mq.get_handle();
+    for (int n = 0; n < 1000; ++n) {
+        handle.push({(n * 7919) % 1000, n});
+    }
+    multiqueue::save_checkpoint(mq, path, 2);
+
+    auto restored = kv_mq_t{4};
+    multiqueue::restore_checkpoint(restored, path, 2);
+    std::filesystem::remove(path);
+    REQUIRE(restored.size() == 1000);
+    std::vector<std::pair<int, int>> expected;
+    mq.drain(std::back_inserter(expected));
+    std::sort(expected.begin(), expected.end());
+    std::vector<std::pair<int, int>> values;
+    auto restored_handle = restored.get_handle();
+    while (auto v = restored_handle.try_pop()) {
+        values.push_back(*v);
+    }
+    std::sort(values.begin(), values.end());
+    REQUIRE(values == expected);
+}
+
+TEMPLATE_TEST_CASE("multiqueue is shared between processes", "[multiqueue][shm][concurrent]", multiqueue::DefaultPolicy,
+                   ShadowPolicy) {
+    using shm_mq_t = multiqueue::shm::ValueMultiQueue<int, std::greater<>, TestType>;
+    static constexpr int num_children = 2;
+    static constexpr int elements_per_child = 10000;
+    auto const name = "/multiqueue_test_" + std::to_string(::getpid());
+    multiqueue::SharedMemorySegment::remove(name);
+    auto segment = multiqueue::SharedMemorySegment::create(name, std::size_t{64} << 20);
+    auto *mq = segment.construct<shm_mq_t>(std::size_t{8}, typename shm_mq_t::config_type{},
+                                           typename shm_mq_t::priority_queue_type(), std::greater<>{},
+                                           segment.get_allocator());
+    REQUIRE_THROWS_AS(segment.construct<int>(), std::logic_error);
+
+    std::vector<pid_t> children;
+    for (int c = 0; c < num_children; ++c) {
+        auto pid = ::fork();
+        REQUIRE(pid != -1);
+        if (pid == 0) {
+            auto push_all = [&] {
+                auto attached = multiqueue::SharedMemorySegment::open(name);
+                auto *shared = attached.find<shm_mq_t>();
+                if (shared == nullptr) {
+                    return 1;
+                }
+                auto handle = shared->get_handle();
+                for (int n = 0; n < elements_per_child; ++n) {
+                    handle.push(c * elements_per_child + n);
+                }
+                return 0;
+            };
+            int status = 1;
+            try {
+                status = push_all();
+            } catch (...) {
+            }
+            std::_Exit(status);
+        }
+        children.push_back(pid);
+    }
+    for (auto pid : children) {
+        int status = 0;
+        REQUIRE(::waitpid(pid, &status, 0) == pid);
+        REQUIRE(WIFEXITED(status));
+        REQUIRE(WEXITSTATUS(status) == 0);
+    }
+    REQUIRE(mq->size() == num_children * elements_per_child);
+    REQUIRE(mq->num_handles() == 0);
+
+    {
+        // Another mapping of the segment lies at another address and reaches the elements only through offset pointers
+        auto second = multiqueue::SharedMemorySegment::open(name);
+        auto *shared = second.find<shm_mq_t>();
+        REQUIRE(shared != mq);
+        auto handle = shared->get_handle();
+        auto values = pop_all(handle);
+        REQUIRE(values.size() == num_children * elements_per_child);
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            REQUIRE(values[i] == static_cast<int>(i));
+        }
+    }
+    segment.destroy<shm_mq_t>();
+    REQUIRE(segment.find<shm_mq_t>() == nullptr);
+    multiqueue::SharedMemorySegment::remove(name);
+}
+
+TEST_CASE("multiqueue can be resized while in use", "[multiqueue][resize][concurrent]") {
+    static constexpr int num_threads = 4;
+    static constexpr int elements_per_thread = 10000;
+
+    auto mq = mq_t{32};
+    std::atomic_bool done{false};
+    std::vector<std::vector<int>> popped(num_threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            auto handle = mq.get_handle();
+            auto &out = popped[static_cast<std::size_t>(t)];
+            for (int i = 0; i < elements_per_thread; ++i) {
+                handle.push(t * elements_per_thread + i);
+                if (i % 2 == 1) {
+                    if (auto v = handle.try_pop()) {
+                        out.push_back(*v);
+                    }
+                }
+            }
+        });
+    }
+    std::thread resizer([&] {
+        std::size_t n = 2;
+        while (!done.load()) {
+            mq.set_num_pqs(n);
+            n = n % 32 + 2;
+        }
+    });
+    for (auto &t : threads) {
+        t.join();
+    }
+    done = true;
+    resizer.join();
+
+    auto handle = mq.get_handle();
+    auto values = pop_all(handle);
+    for (auto const &out : popped) {
+        values.insert(values.end(), out.begin(), out.end());
+    }
+    std::sort(values.begin(), values.end());
+    REQUIRE(values.size() == static_cast<std::size_t>(num_threads * elements_per_thread));
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        REQUIRE(values[i] == static_cast<int>(i));
+    }
+}
+
+TEST_CASE("multiqueue with stick swap works with fewer queues than handles", "[multiqueue][resize][concurrent]") {
+    static constexpr int num_threads = 4;
+    static constexpr int elements_per_thread = 10000;
+
+    using swap_mq_t = multiqueue::ValueMultiQueue<int, std::greater<>, StickSwapPolicy>;
+    // Handles that swap at once hold one target each, which must not starve the others of the remaining ones. A
+    // stickiness of one swaps on every operation.
+    for (std::size_t num_pqs = 2; num_pqs <= std::size_t{num_threads}; ++num_pqs) {
+        auto mq = swap_mq_t{8, swap_mq_t::config_type{1, 1}};
+        mq.set_num_pqs(num_pqs);
+        std::vector<std::vector<int>> popped(num_threads);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&, t] {
+                auto handle = mq.get_handle();
+                auto &out = popped[static_cast<std::size_t>(t)];
+                for (int i = 0; i < elements_per_thread; ++i) {
+                    handle.push(t * elements_per_thread + i);
+                    if (auto v = handle.try_pop()) {
+                        out.push_back(*v);
+                    }
+                }
+            });
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+
+        auto handle = mq.get_handle();
+        auto values = pop_all(handle);
+        for (auto const &out : popped) {
+            values.insert(values.end(), out.begin(), out.end());
+        }
+        std::sort(values.begin(), values.end());
+        REQUIRE(values.size() == static_cast<std::size_t>(num_threads * elements_per_thread));
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            REQUIRE(values[i] == static_cast<int>(i));
+        }
+    }
+}
+
+TEST_CASE("mailbox guard delivers posted values on unlock", "[multiqueue][mailbox]") {
+    using base_guard_t =
+        multiqueue::PQGuard<int, int, multiqueue::utils::Identity, multiqueue::DefaultPriorityQueue<int, std::less<>>,
+                            multiqueue::sentinel::Implicit<int, std::less<>>>;
+    using guard_t = multiqueue::MailboxPQGuard<base_guard_t, int, 2>;
+
+    auto guard = guard_t{};
+    REQUIRE(guard.try_lock());
+    REQUIRE(guard.post(5));
+    REQUIRE(guard.post(6));
+    REQUIRE_FALSE(guard.post(7));
+    REQUIRE(guard.has_mail());
+    REQUIRE(guard.size() == 2);
+    REQUIRE(guard.empty());
+    guard.unlock();
+    REQUIRE_FALSE(guard.has_mail());
+    REQUIRE(guard.size() == 2);
+    REQUIRE(guard.top_key() == 6);
+
+    // Values posted while nobody holds the lock stay until the next lock holder or poster delivers them
+    REQUIRE(guard.post(8));
+    REQUIRE(guard.size() == 3);
+    REQUIRE(guard.try_lock());
+    guard.deliver();
+    REQUIRE(guard.top_key() == 8);
+    guard.unlock();
+    REQUIRE(guard.get_pq().size() == 3);
+}
+
+TEMPLATE_TEST_CASE("multiqueue with push mailboxes loses no element", "[multiqueue][mailbox][concurrent]",
+                   multiqueue::mode::Random<2>, multiqueue::mode::StickMark<2>, multiqueue::mode::StickSwap<2>) {
+    static constexpr int num_threads = 4;
+    static constexpr int elements_per_thread = 10000;
+
+    auto mq = multiqueue::ValueMultiQueue<int, std::greater<>, MailboxPolicy<TestType>>{8};
+    std::atomic_bool done{false};
+    std::vector<std::vector<int>> popped(num_threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            auto handle = mq.get_handle();
+            auto &out = popped[static_cast<std::size_t>(t)];
+            for (int i = 0; i < elements_per_thread; ++i) {
+                handle.push(t * elements_per_thread + i);
+                if (i % 2 == 1) {
+                    if (auto v = handle.try_pop()) {
+                        out.push_back(*v);
+                    }
+                }
+            }
+        });
+    }
+    std::thread resizer([&] {
+        std::size_t n = 2;
+        while (!done.load()) {
+            mq.set_num_pqs(n);
+            n = n % 8 + 2;
+        }
+    });
+    for (auto &t : threads) {
+        t.join();
+    }
+    done = true;
+    resizer.join();
+
+    auto handle = mq.get_handle();
+    auto values = pop_all(handle);
+    for (auto const &out : popped) {
+        values.insert(values.end(), out.begin(), out.end());
+    }
+    std::sort(values.begin(), values.end());
+    REQUIRE(values.size() == static_cast<std::size_t>(num_threads * elements_per_thread));
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        REQUIRE(values[i] == static_cast<int>(i));
+    }
+    REQUIRE(mq.empty());
+}
+
+TEST_CASE("multiqueue handles keep pushed elements that beat their candidates", "[multiqueue][elimination]") {
+    using elimination_mq_t =
+        multiqueue::ValueMultiQueue<int, std::greater<>, EliminationPolicy<multiqueue::mode::Random<2>>>;
+    auto mq = elimination_mq_t{4};
+    {
+        auto handle = mq.get_handle();
+        // The candidates are empty, so the element is pushed
+        handle.push(10);
+        REQUIRE(mq.size() == 1);
+        REQUIRE(handle.stats()[multiqueue::stats::Counter::kept_pushes] == 0);
+        for (int i = 20; i < 120; ++i) {
+            handle.push(i);
+        }
+        // Every queue holds an element worse than 5, kept elements count in the size
+        handle.push(5);
+        REQUIRE(handle.stats()[multiqueue::stats::Counter::kept_pushes] == 1);
+        REQUIRE(mq.size() == 102);
+        // A better element replaces the kept one, which is pushed
+        handle.push(3);
+        REQUIRE(mq.size() == 103);
+        REQUIRE(handle.try_pop() == 3);
+        // Every queue holds an element better than 200
+        handle.push(200);
+        REQUIRE(mq.size() == 103);
+        handle.push(1);
+        REQUIRE(handle.try_pop() == 1);
+        // The kept element is pushed when the handle is destroyed
+        handle.push(0);
+        REQUIRE(mq.size() == 104);
+    }
+    REQUIRE(mq.size() == 104);
+    auto handle = mq.get_handle();
+    auto values = pop_all(handle);
+    REQUIRE(values.front() == 0);
+    REQUIRE(values.size() == 104);
+}
+
+TEST_CASE("multiqueue handles pop elements pushed into empty queues by other handles", "[multiqueue][elimination]") {
+    using elimination_mq_t =
+        multiqueue::ValueMultiQueue<int, std::greater<>, EliminationPolicy<multiqueue::mode::Random<2>>>;
+    auto mq = elimination_mq_t{4};
+    auto first = mq.get_handle();
+    auto second = mq.get_handle();
+    first.push(7);
+    REQUIRE_FALSE(mq.empty());
+    REQUIRE(mq.size() == 1);
+    REQUIRE(second.try_pop() == 7);
+    REQUIRE(mq.empty());
+}
+
+TEMPLATE_TEST_CASE("multiqueue with elimination loses no element", "[multiqueue][elimination][concurrent]",
+                   multiqueue::mode::Random<2>, multiqueue::mode::StickRandom<2>, multiqueue::mode::StickSwap<2>) {
+    static constexpr int num_threads = 4;
+    static constexpr int elements_per_thread = 10000;
+
+    auto mq = multiqueue::ValueMultiQueue<int, std::greater<>, EliminationPolicy<TestType, 2>>{8};
+    std::vector<std::vector<int>> popped(num_threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            auto handle = mq.get_handle();
+            auto &out = popped[static_cast<std::size_t>(t)];
+            for (int i = 0; i < elements_per_thread; ++i) {
+                // The first half fills the queues, then decreasing keys beat the candidates often and half of the
+                // threads mostly pop
+                handle.push(t * elements_per_thread + elements_per_thread - 1 - i);
+                if (i < elements_per_thread / 2) {
+                    continue;
+                }
+                for (int j = 0; j < (t % 2 == 0 ? 1 : 3); ++j) {
+                    if (auto v = handle.try_pop()) {
+                        out.push_back(*v);
+                    }
+                }
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    auto handle = mq.get_handle();
+    auto values = pop_all(handle);
+    for (auto const &out : popped) {
+        values.insert(values.end(), out.begin(), out.end());
+    }
+    std::sort(values.begin(), values.end());
+    REQUIRE(values.size() == static_cast<std::size_t>(num_threads * elements_per_thread));
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        REQUIRE(values[i] == static_cast<int>(i));
+    }
+    REQUIRE(mq.empty());
+    auto const stats = mq.stats();
+    REQUIRE(stats[multiqueue::stats::Counter::kept_pushes] > 0);
+}
+
+TEST_CASE("multiqueue recycles handle ids", "[multiqueue][handle]") {
+    auto mq = mq_t{4};
+    REQUIRE(mq.num_handles() == 0);
+    {
+        auto first = mq.get_handle();
+        auto second = mq.get_handle();
+        REQUIRE(first.id() == 0);
+        REQUIRE(second.id() == 1);
+        REQUIRE(mq.num_handles() == 2);
+        {
+            auto moved = std::move(first);
+            REQUIRE(moved.id() == 0);
+            REQUIRE(mq.num_handles() == 2);
+        }
+        REQUIRE(mq.num_handles() == 1);
+        auto third = mq.get_handle();
+        REQUIRE(third.id() == 0);
+    }
+    REQUIRE(mq.num_handles() == 0);
+}
+
+TEST_CASE("multiqueue reseeds handles with recycled ids", "[multiqueue][handle]") {
+    using profiling_mq_t = multiqueue::ValueMultiQueue<int, std::greater<>, ProfilingPolicy>;
+    auto mq = profiling_mq_t{16};
+    // The queue every push of a new handle goes to, found by the push counts of the profiles
+    auto push_targets = [&mq] {
+        auto handle = mq.get_handle();
+        REQUIRE(handle.id() == 0);
+        std::vector<std::size_t> targets;
+        auto before = mq.guard_profiles();
+        for (int n = 0; n < 32; ++n) {
+            handle.push(n);
+            auto after = mq.guard_profiles();
+            for (std::size_t i = 0; i < after.size(); ++i) {
+                if (after[i].pushes != before[i].pushes) {
+                    targets.push_back(i);
+                }
+            }
+            before = std::move(after);
+        }
+        return targets;
+    };
+    auto const first = push_targets();
+    auto const second = push_targets();
+    REQUIRE(first.size() == 32);
+    REQUIRE(second.size() == 32);
+    REQUIRE(first != second);
+}
+
+TEST_CASE("multiqueue limits the number of live handles of stick swap", "[multiqueue][handle]") {
+    using swap_mq_t = multiqueue::ValueMultiQueue<int, std::greater<>, StickSwapPolicy>;
+    auto mq = swap_mq_t{8};
+    REQUIRE(mq.max_num_handles() == 4);
+
+    // Short-lived handles reuse the ids and thus the permutation entries of destroyed ones
+    for (int i = 0; i < 100; ++i) {
+        auto handle = mq.get_handle();
+        REQUIRE(handle.id() == 0);
+        handle.push(i);
+    }
+
+    std::vector<swap_mq_t::handle_type> handles;
+    for (int i = 0; i < 4; ++i) {
+        handles.push_back(mq.get_handle());
+    }
+    REQUIRE_THROWS_AS(mq.get_handle(), std::length_error);
+    handles.pop_back();
+    REQUIRE(mq.get_handle().id() == 3);
+
+    std::vector<int> values;
+    while (auto v = handles.front().try_pop()) {
+        values.push_back(*v);
+    }
+    REQUIRE(values.size() == 100);
+}
+
+TEST_CASE("multiqueue counts events per handle", "[multiqueue][stats]") {
+    using multiqueue::stats::Counter;
+    using stats_mq_t = multiqueue::ValueMultiQueue<int, std::greater<>, StatsPolicy>;
+    auto mq = stats_mq_t{4};
+    {
+        auto handle = mq.get_handle();
+        for (int n = 0; n < 1000; ++n) {
+            handle.push(n);
+        }
+        while (handle.try_pop()) {
+        }
+        auto const &stats = handle.stats();
+        // Uncontended locks always succeed, 1000 pushes and at least 1001 pops
+        REQUIRE(stats[Counter::lock_attempts] >= 2001);
+        REQUIRE(stats[Counter::lock_failures] == 0);
+        REQUIRE(stats[Counter::empty_candidates] >= 1);
+        REQUIRE(stats[Counter::scan_fallbacks] >= 1);
+        REQUIRE(stats[Counter::buffer_refills] > 0);
+        REQUIRE(stats[Counter::buffer_flushes] > 0);
+        REQUIRE(mq.stats()[Counter::lock_attempts] == 0);
+    }
+    REQUIRE(mq.stats()[Counter::lock_attempts] >= 2001);
+}
+
+TEST_CASE("multiqueue profiles its queues", "[multiqueue][profile]") {
+    using profiling_mq_t = multiqueue::ValueMultiQueue<int, std::greater<>, ProfilingPolicy>;
+    auto mq = profiling_mq_t{4};
+    auto handle = mq.get_handle();
+    for (int n = 0; n < 1000; ++n) {
+        handle.push(n);
+    }
+    auto values = std::vector<int>{};
+    while (auto v = handle.try_pop()) {
+        values.push_back(*v);
+    }
+
+    auto profiles = mq.guard_profiles();
+    REQUIRE(profiles.size() == 4);
+    std::uint64_t pushes = 0;
+    std::uint64_t pops = 0;
+    for (auto const &profile : profiles) {
+        pushes += profile.pushes;
+        pops += profile.pops;
+        REQUIRE(profile.failed_lock_attempts == 0);
+        REQUIRE(profile.lock_acquisitions >= profile.pushes + profile.pops);
+    }
+    REQUIRE(pushes == 1000);
+    REQUIRE(pops == 1000);
+
+    std::ostringstream out;
+    mq.print_heat_table(out);
+    auto table = out.str();
+    REQUIRE(std::count(table.begin(), table.end(), '\n') == 5);
+}
+
+TEST_CASE("multiqueue profiles pushes delivered from mailboxes", "[multiqueue][profile][mailbox]") {
+    using base_guard_t =
+        multiqueue::PQGuard<int, int, multiqueue::utils::Identity, multiqueue::DefaultPriorityQueue<int, std::less<>>,
+                            multiqueue::sentinel::Implicit<int, std::less<>>>;
+    using guard_t = multiqueue::MailboxPQGuard<multiqueue::ProfilingPQGuard<base_guard_t>, int, 2>;
+
+    auto guard = guard_t{};
+    REQUIRE(guard.try_lock());
+    REQUIRE(guard.post(5));
+    REQUIRE(guard.post(6));
+    guard.unlock();
+    REQUIRE(guard.profile().pushes == 2);
+    REQUIRE(guard.profile().lock_acquisitions == 1);
+
+    static constexpr int num_threads = 4;
+    static constexpr int elements_per_thread = 10000;
+    auto mq = multiqueue::ValueMultiQueue<int, std::greater<>, MailboxProfilingPolicy>{2};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&] {
+            auto handle = mq.get_handle();
+            for (int i = 0; i < elements_per_thread; ++i) {
+                handle.push(i);
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    std::uint64_t pushes = 0;
+    for (auto const &profile : mq.guard_profiles()) {
+        pushes += profile.pushes;
+    }
+    REQUIRE(pushes == num_threads * elements_per_thread);
+}
+
+TEST_CASE("multiqueue parks contending threads", "[multiqueue][backoff][concurrent]") {
+    static constexpr int num_threads = 8;
+    static constexpr int elements_per_thread = 10000;
+    using parking_mq_t = multiqueue::ValueMultiQueue<int, std::greater<>, ParkingPolicy>;
+
+    // Few queues for many threads, so locks are contended
+    auto mq = parking_mq_t{2};
+    std::vector<std::vector<int>> popped(num_threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            auto handle = mq.get_handle();
+            auto &out = popped[static_cast<std::size_t>(t)];
+            for (int i = 0; i < elements_per_thread; ++i) {
+                handle.push(t * elements_per_thread + i);
+                if (auto v = handle.try_pop()) {
+                    out.push_back(*v);
+                }
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    std::vector<int> values;
+    for (auto const &out : popped) {
+        values.insert(values.end(), out.begin(), out.end());
+    }
+    auto handle = mq.get_handle();
+    while (auto v = handle.try_pop()) {
+        values.push_back(*v);
+    }
+    std::sort(values.begin(), values.end());
+    REQUIRE(values.size() == static_cast<std::size_t>(num_threads * elements_per_thread));
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        REQUIRE(values[i] == static_cast<int>(i));
+    }
+}
+
+TEST_CASE("seqlock top key never reads torn keys", "[multiqueue][top_key][concurrent]") {
+    using top_key_t = multiqueue::SeqlockTopKey<WideKey>;
+    static_assert(!std::atomic<WideKey>::is_always_lock_free);
+
+    auto top_key = top_key_t{WideKey{1, 1}};
+    std::atomic_bool done = false;
+    std::atomic_bool torn = false;
+    std::thread reader([&] {
+        while (!done.load(std::memory_order_relaxed)) {
+            auto key = top_key.load();
+            // A store in progress must not make the key look like the sentinel, i.e. the queue empty
+            if (key.time != key.id || key.time == 0) {
+                torn.store(true, std::memory_order_relaxed);
+            }
+        }
+    });
+    for (std::uint64_t n = 2; n < 100000; ++n) {
+        top_key.store(WideKey{n, n});
+    }
+    done.store(true, std::memory_order_relaxed);
+    reader.join();
+    REQUIRE_FALSE(torn.load());
+    REQUIRE(top_key.load() == WideKey{99999, 99999});
+}
+
+TEST_CASE("multiqueue supports keys without lock-free atomics", "[multiqueue][top_key][concurrent]") {
+    static constexpr int num_threads = 4;
+    static constexpr int elements_per_thread = 10000;
+    using wide_mq_t = multiqueue::KeyValueMultiQueue<WideKey, int, std::greater<>, multiqueue::DefaultPolicy,
+                                                     multiqueue::DefaultPriorityQueue<
+                                                         std::pair<WideKey, int>,
+                                                         multiqueue::utils::ValueCompare<std::pair<WideKey, int>,
+                                                                                         multiqueue::utils::PairFirst,
+                                                                                         std::greater<>>>,
+                                                     multiqueue::sentinel::DefaultConstruct<WideKey, std::greater<>>>;
+
+    auto mq = wide_mq_t{8};
+    std::vector<std::vector<int>> popped(num_threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            auto handle = mq.get_handle();
+            auto &out = popped[static_cast<std::size_t>(t)];
+            for (int i = 0; i < elements_per_thread; ++i) {
+                auto const value = t * elements_per_thread + i;
+                // Time starts at 1, so no key equals the sentinel
+                handle.push({WideKey{static_cast<std::uint64_t>(i + 1), static_cast<std::uint64_t>(t)}, value});
+                if (auto v = handle.try_pop()) {
+                    out.push_back(v->second);
+                }
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    std::vector<int> values;
+    for (auto const &out : popped) {
+        values.insert(values.end(), out.begin(), out.end());
+    }
+    auto handle = mq.get_handle();
+    while (auto v = handle.try_pop()) {
+        values.push_back(v->second);
+    }
+    std::sort(values.begin(), values.end());
+    REQUIRE(values.size() == static_cast<std::size_t>(num_threads * elements_per_thread));
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        REQUIRE(values[i] == static_cast<int>(i));
+    }
+}
+
+TEST_CASE("top key shadow finds the best key of a range", "[multiqueue][shadow]") {
+    using shadow_t = multiqueue::TopKeyShadow<std::uint64_t, std::greater<>,
+                                              multiqueue::sentinel::Implicit<std::uint64_t, std::greater<>>>;
+    static constexpr std::size_t size = 37;
+    auto shadow = shadow_t{size};
+
+    REQUIRE(shadow.best(0, size, {}).second == std::numeric_limits<std::uint64_t>::max());
+    for (std::size_t i = 0; i < size; ++i) {
+        // Large keys have the sign bit set, which must not make them better
+        shadow.slot(i).store(i % 2 == 0 ? (std::uint64_t{1} << 63) + i : 1000 - i);
+    }
+    for (std::size_t first = 0; first < size; ++first) {
+        for (std::size_t last = first + 1; last <= size; ++last) {
+            auto expected = first;
+            for (auto i = first; i < last; ++i) {
+                if (shadow.load(i) < shadow.load(expected)) {
+                    expected = i;
+                }
+            }
+            auto [index, key] = shadow.best(first, last, {});
+            REQUIRE(index == expected);
+            REQUIRE(key == shadow.load(expected));
+        }
+    }
+}
+
+TEST_CASE("multiqueue keeps the top key shadow up to date", "[multiqueue][shadow][concurrent]") {
+    static constexpr int num_threads = 4;
+    static constexpr int elements_per_thread = 10000;
+    using shadow_mq_t = multiqueue::ValueMultiQueue<int, std::greater<>, ShadowPolicy>;
+
+    auto mq = shadow_mq_t{16};
+    {
+        // With a single handle, the shadowed scan pops the global minimum
+        auto handle = mq.get_handle();
+        for (int n = 0; n < 100; ++n) {
+            handle.push(n);
+        }
+        for (int n = 0; n < 100; ++n) {
+            REQUIRE(handle.scan() == n);
+        }
+        REQUIRE_FALSE(handle.try_pop());
+    }
+
+    std::vector<std::vector<int>> popped(num_threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            auto handle = mq.get_handle();
+            auto &out = popped[static_cast<std::size_t>(t)];
+            for (int i = 0; i < elements_per_thread; ++i) {
+                handle.push(t * elements_per_thread + i);
+                if (auto v = handle.try_pop()) {
+                    out.push_back(*v);
+                }
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    std::vector<int> values;
+    for (auto const &out : popped) {
+        values.insert(values.end(), out.begin(), out.end());
+    }
+    auto handle = mq.get_handle();
+    while (auto v = handle.try_pop()) {
+        values.push_back(*v);
+    }
+    std::sort(values.begin(), values.end());
+    REQUIRE(values.size() == static_cast<std::size_t>(num_threads * elements_per_thread));
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        REQUIRE(values[i] == static_cast<int>(i));
+    }
+}
+
+TEST_CASE("multiqueue propagates its allocator into the queues", "[multiqueue][allocator]") {
+    using pmr_mq_t = multiqueue::pmr::ValueMultiQueue<int, std::greater<>>;
+    CountingResource resource;
+    {
+        auto mq = pmr_mq_t{4, 1000, {}, pmr_mq_t::priority_queue_type(), {}, &resource};
+        REQUIRE(mq.get_allocator().resource() == &resource);
+        auto const reserved = resource.allocated();
+        // The guards and the reserved storage of every queue
+        REQUIRE(reserved >= 4 * 2 * 250 * sizeof(int));
+
+        auto handle = mq.get_handle();
+        for (int n = 0; n < 10000; ++n) {
+            handle.push(n);
+        }
+        REQUIRE(resource.allocated() > reserved);
+        for (int n = 0; n < 10000; ++n) {
+            REQUIRE(handle.try_pop());
+        }
+    }
+    REQUIRE(resource.allocated() == 0);
+}
+
+TEST_CASE("multiqueue allocates the top key shadow from its allocator", "[multiqueue][allocator][shadow]") {
+    using pmr_mq_t = multiqueue::pmr::ValueMultiQueue<int, std::greater<>>;
+    using pmr_shadow_mq_t = multiqueue::pmr::ValueMultiQueue<int, std::greater<>, ShadowPolicy>;
+    CountingResource resource;
+    CountingResource shadow_resource;
+    {
+        auto mq = pmr_mq_t{8, {}, pmr_mq_t::priority_queue_type(), {}, &resource};
+        auto shadow_mq = pmr_shadow_mq_t{8, {}, pmr_shadow_mq_t::priority_queue_type(), {}, &shadow_resource};
+        REQUIRE(shadow_mq.memory_usage().shadow > 0);
+        REQUIRE(shadow_resource.allocated() >= resource.allocated() + shadow_mq.memory_usage().shadow);
+    }
+    REQUIRE(shadow_resource.allocated() == 0);
+}
+
+TEST_CASE("multiqueue keeps the allocators of given queues", "[multiqueue][allocator]") {
+    using pmr_mq_t = multiqueue::pmr::ValueMultiQueue<int, std::greater<>>;
+    using pq_t = pmr_mq_t::priority_queue_type;
+    std::vector<CountingResource> resources(4);
+    {
+        std::vector<pq_t> pqs;
+        for (auto &r : resources) {
+            pqs.emplace_back(std::greater<>{}, std::pmr::polymorphic_allocator<int>(&r));
+        }
+        auto mq = pmr_mq_t{pqs.begin(), pqs.end()};
+        auto handle = mq.get_handle();
+        for (int n = 0; n < 10000; ++n) {
+            handle.push(n);
+        }
+        for (auto const &r : resources) {
+            REQUIRE(r.allocated() > 0);
+        }
+        REQUIRE(pop_all(handle).size() == 10000);
+    }
+    for (auto const &r : resources) {
+        REQUIRE(r.allocated() == 0);
+    }
+}
+
+TEST_CASE("huge page resource maps aligned memory", "[multiqueue][allocator]") {
+    CountingResource upstream;
+    auto resource = multiqueue::HugePageResource{multiqueue::HugePageResource::huge_page_size, &upstream};
+
+    auto *small = resource.allocate(1024);
+    REQUIRE(upstream.allocated() == 1024);
+    resource.deallocate(small, 1024);
+
+    constexpr std::size_t size = 3 * multiqueue::HugePageResource::huge_page_size + 1;
+    auto *large = static_cast<char *>(resource.allocate(size));
+#if defined(__linux__)
+    REQUIRE(upstream.allocated() == 0);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(large) % multiqueue::HugePageResource::huge_page_size == 0);
+#endif
+    std::fill(large, large + size, 'x');
+    resource.deallocate(large, size);
 }